@@ -180,6 +180,17 @@ public:
         return (action == f.action && time_spec == f.time_spec && minDuration == f.minDuration && maxDuration == f.maxDuration && pairWithStep == f.pairWithStep && getEffects == f.getEffects && divisionID == f.divisionID);
     }
 
+    /** @brief Whether a copy of <code>f</code> would be indistinguishable from this event, timestamps and all. */
+    bool identicalTo(const FFEvent & f) const {
+        #ifdef STOCHASTICDURATIONS
+        if (stochasticTimestamp || f.stochasticTimestamp) return false;
+        #endif
+        return (action == f.action && time_spec == f.time_spec && minDuration == f.minDuration && maxDuration == f.maxDuration
+                && pairWithStep == f.pairWithStep && getEffects == f.getEffects && lpTimestamp == f.lpTimestamp
+                && lpMinTimestamp == f.lpMinTimestamp && lpMaxTimestamp == f.lpMaxTimestamp && divisionID == f.divisionID
+                && needToFinish == f.needToFinish);
+    }
+
     bool isDummyStep() const {
         return (time_spec == Planner::E_CONTINUOUS
                 || time_spec == Planner::E_DUMMY_TEMPORAL_GOAL_TRUE || time_spec == Planner::E_DUMMY_TEMPORAL_TRIGGER_TRUE
@@ -42,9 +42,14 @@
 #endif
 
 #include "partialordertransformer.h"
+#include "searchprofile.h"
+#include "objectpool.h"
 
 #include <cfloat>
+#include <forward_list>
 #include <limits>
+#include <memory>
+#include <unordered_map>
 
 #include <sys/times.h>
 #include <unistd.h>
@@ -54,15 +59,10 @@
 namespace Planner
 {
 
-Solution FF::workingBestSolution;
+void (*FF::newBestSolution)(const Solution & solution) = 0;
 
-list<pair<double, list<ActionSegment> > > FFcache_relaxedPlan;
-list<ActionSegment> FFcache_helpfulActions;
-RPGHeuristic::EvaluationInfo FFcache_h;
-bool FFcache_upToDate;
 bool FFheader_upToDate;
 bool FFonly_one_successor;
-double FFcache_makespanEstimate;
 bool FF::steepestDescent = true;
 
 double FF::doubleU = 5.0;
@@ -93,9 +93,175 @@ bool FF::openListOrderLowMakespanFirst = false;
 bool FF::openListOrderLowCostFirst = false;
 bool FF::skipRPG = false;
 bool FF::allowCompressionSafeScheduler = false;
-int FF::statesDiscardedAsTooExpensiveBeforeHeuristic = 0;
 
 bool FF::costOptimalAStar = false;
+bool FF::deferredEvaluation = false;
+bool FF::reuseSearchAcrossWeights = false;
+bool FF::preferredQueue = false;
+int FF::preferredQueueBoost = 0;
+unsigned int FF::heuristicCacheEntries = 4096;
+
+/** @brief Heuristic evaluations, kept by everything they were computed from: see <code>CSBase::packHeuristicInputs</code>.
+ *
+ *  When search reaches a state it has evaluated before, under the same temporal constraints (after an EHC restart,
+ *  say, or in best-first search after EHC fails), the evaluation is reused rather than the RPG being built again.
+ *  At most <code>FF::heuristicCacheEntries</code> evaluations are kept, discarding the least recently used.
+ *  The RPG also reads the cost bound (<code>Globals::bestSolutionQuality</code>) and the goal deadlines, which
+ *  are not part of the key, so the cache is emptied whenever a better plan tightens them.
+ */
+class HeuristicCache
+{
+
+public:
+
+    struct Entry {
+        list<pair<double, list<ActionSegment> > > relaxedPlan;
+        list<ActionSegment> helpfulActions;
+        RPGHeuristic::EvaluationInfo h;
+        double makespanEstimate;
+
+        /** @brief This entry's place in <code>HeuristicCache::leastRecentFirst</code>. */
+        list<const string*>::iterator recency;
+
+        Entry() : makespanEstimate(0.0) {
+        }
+    };
+
+private:
+
+    typedef std::unordered_map<string, Entry> EntryMap;
+
+    EntryMap entries;
+
+    /** @brief The keys of <code>entries</code>, from the least recently used to the most. */
+    list<const string*> leastRecentFirst;
+
+    unsigned long hits;
+    unsigned long misses;
+
+public:
+
+    HeuristicCache() : hits(0), misses(0) {
+    }
+
+    /** @brief The evaluation with the given inputs, if kept, or 0 if not. */
+    const Entry * find(const string & key) {
+        const EntryMap::iterator eItr = entries.find(key);
+        if (eItr == entries.end()) {
+            ++misses;
+            return 0;
+        }
+        ++hits;
+        leastRecentFirst.splice(leastRecentFirst.end(), leastRecentFirst, eItr->second.recency);
+        return &(eItr->second);
+    }
+
+    /** @brief Make room for, and return, a new entry for the evaluation with the given inputs. */
+    Entry & insert(const string & key) {
+        if (entries.size() >= FF::heuristicCacheEntries) {
+            const string * const oldest = leastRecentFirst.front();
+            leastRecentFirst.pop_front();
+            entries.erase(*oldest);
+        }
+        const pair<EntryMap::iterator, bool> insResult = entries.insert(make_pair(key, Entry()));
+        assert(insResult.second);
+        insResult.first->second.recency = leastRecentFirst.insert(leastRecentFirst.end(), &(insResult.first->first));
+        return insResult.first->second;
+    }
+
+    /** @brief Forget all the evaluations kept, but not the hits and misses so far. */
+    void forgetEvaluations() {
+        entries.clear();
+        leastRecentFirst.clear();
+    }
+
+    /** @brief Forget all the evaluations kept, and the hits and misses so far. */
+    void clear() {
+        forgetEvaluations();
+        hits = 0;
+        misses = 0;
+    }
+
+    unsigned long getHits() const {
+        return hits;
+    }
+
+    unsigned long getMisses() const {
+        return misses;
+    }
+};
+
+FF::SearchContext::SearchContext()
+    : heuristicCache(new HeuristicCache()), statesDiscardedAsTooExpensiveBeforeHeuristic(0), haveTILs(false), tilCount(0)
+{
+}
+
+FF::SearchContext::~SearchContext()
+{
+}
+
+/** @brief The context installed by the innermost <code>FF::SearchContext::Use</code> in scope, if any. */
+static FF::SearchContext * currentSearchContext = 0;
+
+FF::SearchContext::Use::Use(SearchContext & c)
+    : previous(currentSearchContext)
+{
+    currentSearchContext = &c;
+}
+
+FF::SearchContext::Use::~Use()
+{
+    currentSearchContext = previous;
+}
+
+FF::SearchContext & FF::context()
+{
+    if (currentSearchContext) {
+        return *currentSearchContext;
+    }
+    static SearchContext * const defaultContext = new SearchContext();
+    return *defaultContext;
+}
+
+/** @brief Fill in the TILs' timestamps and delete effects in <code>c</code>, if not done already. */
+static void summariseTILs(FF::SearchContext & c)
+{
+    if (c.haveTILs) {
+        return;
+    }
+    c.haveTILs = true;
+
+    vector<RPGBuilder::FakeTILAction*> & tilVec = RPGBuilder::getNonAbstractedTILVec();
+    c.tilCount = tilVec.size();
+    c.tilStamps = vector<double>(c.tilCount);
+    c.tilNegativeEffects = vector<list<int> >(c.tilCount);
+    c.tilPermanentNegativeEffects = vector<list<int> >(c.tilCount);
+    set<int> addedLater;
+    for (int i = c.tilCount - 1; i >= 0; --i) {
+        c.tilStamps[i] = tilVec[i]->duration;
+        {
+            list<Literal*>::iterator effItr = tilVec[i]->addEffects.begin();
+            const list<Literal*>::iterator effEnd = tilVec[i]->addEffects.end();
+
+            for (; effItr != effEnd; ++effItr) {
+                addedLater.insert((*effItr)->getStateID());
+            }
+        }
+
+        {
+            list<Literal*>::iterator effItr = tilVec[i]->delEffects.begin();
+            const list<Literal*>::iterator effEnd = tilVec[i]->delEffects.end();
+
+            for (; effItr != effEnd; ++effItr) {
+                const int currEffID = (*effItr)->getStateID();
+                c.tilNegativeEffects[i].push_back(currEffID);
+                if (RPGBuilder::getEffectsToActions(currEffID).empty() && addedLater.find(currEffID) == addedLater.end()) {
+                    c.tilPermanentNegativeEffects[i].push_back(currEffID);
+                }
+            }
+        }
+    }
+}
 
 #ifdef POPF3ANALYSIS
 double FF::reprocessQualityBound = std::numeric_limits<double>::signaling_NaN();
@@ -392,7 +558,10 @@ pair<bool,bool> FF::carryOnSearching(const MinimalState & theState,  const list<
 
     wasNewBestSolution = false;
     if (!Globals::optimiseSolutionQuality) {
-        workingBestSolution.update(plan, theState.temporalConstraints, evaluateMetric(theState, plan, false));
+        context().workingBestSolution.update(plan, theState.temporalConstraints, evaluateMetric(theState, plan, false));
+        if (newBestSolution) {
+            newBestSolution(context().workingBestSolution);
+        }
         if (Globals::globalVerbosity & 1) {
             cout << "g"; cout.flush();
         }
@@ -439,9 +608,13 @@ pair<bool,bool> FF::carryOnSearching(const MinimalState & theState,  const list<
         cout << endl;
         if (currentCost.first) {
             cout << "; LP calculated the cost\n";
-            workingBestSolution.update(plan, theState.temporalConstraints, currentCost.second);
+            context().workingBestSolution.update(plan, theState.temporalConstraints, currentCost.second);
         } else {
-            workingBestSolution.update(plan, theState.temporalConstraints, evaluateMetric(theState, plan, true));
+            context().workingBestSolution.update(plan, theState.temporalConstraints, evaluateMetric(theState, plan, true));
+        }
+
+        if (newBestSolution) {
+            newBestSolution(context().workingBestSolution);
         }
 
         cout << endl << "; Plan found with metric " << realMetric << endl;
@@ -449,9 +622,12 @@ pair<bool,bool> FF::carryOnSearching(const MinimalState & theState,  const list<
             cout << "; Theoretical reachable cost " << gCost << endl;
         }
         cout << "; States evaluated so far: " << RPGHeuristic::statesEvaluated << endl;
+        if (heuristicCacheEntries) {
+            cout << "; Heuristic cache: " << context().heuristicCache->getHits() << " hits, " << context().heuristicCache->getMisses() << " misses" << endl;
+        }
 #ifdef POPF3ANALYSIS
         if (Globals::optimiseSolutionQuality) {
-            cout << "; States pruned based on pre-heuristic cost lower bound: " << statesDiscardedAsTooExpensiveBeforeHeuristic << endl;
+            cout << "; States pruned based on pre-heuristic cost lower bound: " << context().statesDiscardedAsTooExpensiveBeforeHeuristic << endl;
         }
 #endif
         FFEvent::printPlan(plan);
@@ -465,6 +641,9 @@ pair<bool,bool> FF::carryOnSearching(const MinimalState & theState,  const list<
 
         RPGBuilder::getHeuristic()->metricHasChanged();
 
+        // evaluations cached under the old bound (and goal deadlines, below) could now be wrong
+        context().heuristicCache->forgetEvaluations();
+
         bool metricIsMinimiseMakespan = false;
 
         if (!theMetric) {
@@ -522,7 +701,10 @@ pair<bool,bool> FF::carryOnSearching(const MinimalState & theState,  const list<
     if (Globals::globalVerbosity & 1) {
         cout << "g"; cout.flush();
     }
-    workingBestSolution.update(plan, theState.temporalConstraints, evaluateMetric(theState, plan, false));
+    context().workingBestSolution.update(plan, theState.temporalConstraints, evaluateMetric(theState, plan, false));
+    if (newBestSolution) {
+        newBestSolution(context().workingBestSolution);
+    }
 
     return make_pair(false, false);
 }
@@ -1497,7 +1679,234 @@ bool fullLessThan(const ExtendedMinimalState & ae, const ExtendedMinimalState &
 
 }
 
+/** @brief Fold <code>v</code> into the order-dependent hash <code>h</code>. */
+static inline unsigned long long hashCombine(const unsigned long long & h, const unsigned long long & v)
+{
+    return zobristKey(h ^ (v + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2)));
+}
+
+static inline unsigned long long hashStep(const StepAndBeforeOrAfter & s)
+{
+    return (static_cast<unsigned long long>(s.stepID) << 1) | s.beforeOrAfter;
+}
+
+unsigned long long weakHash(const ExtendedMinimalState & ae)
+{
+    const MinimalState & a = ae.getInnerState();
+
+    // facts: kept up to date as each state is built from its parent, rather than visiting every fact here
+    unsigned long long toReturn = a.factsHash;
+#ifdef STATEHASHDEBUG
+    {
+        unsigned long long recomputed = 0;
+        StateFacts::const_iterator fItr = a.first.begin();
+        const StateFacts::const_iterator fEnd = a.first.end();
+        for (; fItr != fEnd; ++fItr) {
+            recomputed ^= zobristKey(FACTA(fItr));
+        }
+        assert(recomputed == toReturn);
+    }
+#endif
+
+    // the numeric values are left out: compareVecs compares them to within a tolerance, so close values must share a hash
+
+    {
+        map<int, set<int> >::const_iterator saItr = a.startedActions.begin();
+        const map<int, set<int> >::const_iterator saEnd = a.startedActions.end();
+        for (; saItr != saEnd; ++saItr) {
+            unsigned long long started = zobristKey(~static_cast<unsigned long long>(saItr->first));
+            set<int>::const_iterator stepItr = saItr->second.begin();
+            const set<int>::const_iterator stepEnd = saItr->second.end();
+            for (; stepItr != stepEnd; ++stepItr) {
+                started = hashCombine(started, *stepItr);
+            }
+            toReturn = hashCombine(toReturn, started);
+        }
+    }
+
+    return hashCombine(toReturn, a.nextTIL);
+}
+
+unsigned long long secondaryHash(const ExtendedMinimalState & ae)
+{
+    unsigned long long toReturn = 0;
+
+    #ifndef TOTALORDERSTATES
+    {
+        const MinimalState & a = ae.getInnerState();
+
+        StateFacts::const_iterator fItr = a.first.begin();
+        const StateFacts::const_iterator fEnd = a.first.end();
+        for (; fItr != fEnd; ++fItr) {
+            unsigned long long annotation = hashCombine(fItr->first, hashStep(fItr->second.availableFrom));
+
+            map<StepAndBeforeOrAfter, bool>::const_iterator dItr = fItr->second.deletableFrom.begin();
+            const map<StepAndBeforeOrAfter, bool>::const_iterator dEnd = fItr->second.deletableFrom.end();
+            for (; dItr != dEnd; ++dItr) {
+                annotation = hashCombine(annotation, (hashStep(dItr->first) << 1) | dItr->second);
+            }
+            toReturn ^= zobristKey(annotation);
+        }
+    }
+    #endif
+
+    // terminated events are skipped, as in compareLists
+    list<StartEvent>::const_iterator evItr = ae.startEventQueue.begin();
+    const list<StartEvent>::const_iterator evEnd = ae.startEventQueue.end();
+    for (; evItr != evEnd; ++evItr) {
+        if (!evItr->terminated) {
+            toReturn = hashCombine(toReturn, evItr->actID);
+        }
+    }
+
+    return toReturn;
+}
+
+static inline void appendVarint(string & bytes, unsigned long long v)
+{
+    while (v >= 0x80) {
+        bytes.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    bytes.push_back(static_cast<char>(v));
+}
+
+static inline unsigned long long readVarint(const string & bytes, size_t & from)
+{
+    unsigned long long toReturn = 0;
+    int shift = 0;
+    while (true) {
+        const unsigned char b = bytes[from++];
+        toReturn |= static_cast<unsigned long long>(b & 0x7F) << shift;
+        if (!(b & 0x80)) return toReturn;
+        shift += 7;
+    }
+}
+
+/** @brief Append a set of (ascending) non-negative integers, as their count and then the gaps between them. */
+template<typename Itr>
+static inline void appendAscending(string & bytes, const size_t & count, Itr itr, const Itr & itrEnd)
+{
+    appendVarint(bytes, count);
+    unsigned long long previous = 0;
+    for (; itr != itrEnd; ++itr) {
+        const unsigned long long v = static_cast<unsigned int>(*itr);
+        appendVarint(bytes, v - previous);
+        previous = v;
+    }
+}
+
+void packWeakProjection(const ExtendedMinimalState & ae, string & bytes)
+{
+    const MinimalState & a = ae.getInnerState();
+
+    bytes.clear();
+
+    // numeric values first, raw, so comparePackedWeakProjections can compare them to within a tolerance, as compareVecs does
+    {
+        const int pneCount = a.secondMin.size();
+        int kept = 0;
+        for (int i = 0; i < pneCount; ++i) {
+            if (!ignorableFluents[i]) ++kept;
+        }
+        appendVarint(bytes, kept);
+        for (int i = 0; i < pneCount; ++i) {
+            if (!ignorableFluents[i]) {
+                bytes.append(reinterpret_cast<const char*>(&(a.secondMin[i])), sizeof(double));
+                bytes.append(reinterpret_cast<const char*>(&(a.secondMax[i])), sizeof(double));
+            }
+        }
+    }
+
+    appendVarint(bytes, a.first.size());
+    {
+        unsigned long long previous = 0;
+        StateFacts::const_iterator fItr = a.first.begin();
+        const StateFacts::const_iterator fEnd = a.first.end();
+        for (; fItr != fEnd; ++fItr) {
+            const unsigned long long fact = FACTA(fItr);
+            appendVarint(bytes, fact - previous);
+            previous = fact;
+        }
+    }
+
+    appendVarint(bytes, a.startedActions.size());
+    {
+        unsigned long long previous = 0;
+        map<int, set<int> >::const_iterator saItr = a.startedActions.begin();
+        const map<int, set<int> >::const_iterator saEnd = a.startedActions.end();
+        for (; saItr != saEnd; ++saItr) {
+            const unsigned long long act = saItr->first;
+            appendVarint(bytes, act - previous);
+            previous = act;
+            appendAscending(bytes, saItr->second.size(), saItr->second.begin(), saItr->second.end());
+        }
+    }
+
+    // zig-zag encoded, in case it is negative
+    appendVarint(bytes, (static_cast<unsigned long long>(a.nextTIL) << 1) ^ static_cast<unsigned long long>(static_cast<long long>(a.nextTIL) >> 63));
+}
+
+/** @brief Order two weak projections packed by <code>packWeakProjection</code>, as compareVecs and friends order the states themselves.
+ *
+ *  The facts, started actions and next TIL are compared byte-for-byte, and then the numeric values to within a tolerance.
+ */
+int comparePackedWeakProjections(const string & a, const string & b)
+{
+    if (a.size() < b.size()) return -1;
+    if (a.size() > b.size()) return 1;
+
+    size_t from = 0;
+    const unsigned long long kept = readVarint(a, from);
+    const size_t numericEnd = from + kept * 2 * sizeof(double);
+
+    const int rest = a.compare(numericEnd, string::npos, b, numericEnd, string::npos);
+    if (rest < 0) return -1;
+    if (rest > 0) return 1;
+
+    double av, bv;
+    for (; from < numericEnd; from += sizeof(double)) {
+        memcpy(&av, a.data() + from, sizeof(double));
+        memcpy(&bv, b.data() + from, sizeof(double));
+        if (av < bv - 0.0005) return -1;
+        if (av > bv + 0.0005) return 1;
+    }
+
+    return 0;
+}
 
+void packSecondaryProjection(const ExtendedMinimalState & ae, string & bytes)
+{
+    bytes.clear();
+
+    #ifndef TOTALORDERSTATES
+    {
+        // the facts themselves are in the weak projection, so only their annotations are needed
+        const MinimalState & a = ae.getInnerState();
+
+        StateFacts::const_iterator fItr = a.first.begin();
+        const StateFacts::const_iterator fEnd = a.first.end();
+        for (; fItr != fEnd; ++fItr) {
+            appendVarint(bytes, hashStep(fItr->second.availableFrom));
+            appendVarint(bytes, fItr->second.deletableFrom.size());
+
+            map<StepAndBeforeOrAfter, bool>::const_iterator dItr = fItr->second.deletableFrom.begin();
+            const map<StepAndBeforeOrAfter, bool>::const_iterator dEnd = fItr->second.deletableFrom.end();
+            for (; dItr != dEnd; ++dItr) {
+                appendVarint(bytes, (hashStep(dItr->first) << 1) | dItr->second);
+            }
+        }
+    }
+    #endif
+
+    list<StartEvent>::const_iterator evItr = ae.startEventQueue.begin();
+    const list<StartEvent>::const_iterator evEnd = ae.startEventQueue.end();
+    for (; evItr != evEnd; ++evItr) {
+        if (!evItr->terminated) {
+            appendVarint(bytes, evItr->actID);
+        }
+    }
+}
 
 };
 
@@ -1545,6 +1954,79 @@ bool ExtendedStateLessThanOnPropositionsAndNonDominatedVariables::operator()(con
     return CSBase::propAndNonDominatedVariableLessThan(ae, be);
 }
 
+struct DeferredEvaluation;
+
+/** @brief A plan, stored as the changes made to the plan of the state it was reached from.
+ *
+ *  A successor's plan is its parent's, rescheduled, followed by the steps just added.  Rescheduling changes
+ *  the timestamps of only some of the parent's steps, so the plans of the states waiting on the open list are
+ *  kept as a tree of these nodes, rather than as full copies.  Nodes are never changed once made.
+ */
+struct PlanNode {
+    std::shared_ptr<const PlanNode> parent;
+
+    /** @brief The number of steps in the parent's plan. */
+    size_t parentLength;
+
+    /** @brief The parent's steps that are different in this plan, by index. */
+    vector<pair<size_t, FFEvent> > changedSteps;
+
+    /** @brief The steps after the parent's. */
+    vector<FFEvent> newSteps;
+
+    /** @brief A node holding the whole of <code>plan</code>. */
+    PlanNode(const list<FFEvent> & plan)
+        : parentLength(0), newSteps(plan.begin(), plan.end()) {
+    }
+
+    /** @brief A node holding <code>plan</code> as the changes from <code>parentIn</code>, the steps of which are <code>parentSteps</code>. */
+    PlanNode(const std::shared_ptr<const PlanNode> & parentIn, const vector<const FFEvent*> & parentSteps, const list<FFEvent> & plan)
+        : parent(parentIn), parentLength(parentSteps.size()) {
+
+        assert(plan.size() >= parentLength);
+
+        list<FFEvent>::const_iterator pItr = plan.begin();
+        const list<FFEvent>::const_iterator pEnd = plan.end();
+
+        for (size_t i = 0; i < parentLength; ++i, ++pItr) {
+            if (!pItr->identicalTo(*(parentSteps[i]))) {
+                changedSteps.push_back(make_pair(i, *pItr));
+            }
+        }
+
+        newSteps.insert(newSteps.end(), pItr, pEnd);
+    }
+
+    /** @brief Get the steps of the plan, pointing into this node and its ancestors. */
+    void getSteps(vector<const FFEvent*> & steps) const {
+        vector<const PlanNode*> path;
+        for (const PlanNode * n = this; n; n = n->parent.get()) {
+            path.push_back(n);
+        }
+
+        steps.clear();
+
+        vector<const PlanNode*>::const_reverse_iterator nItr = path.rbegin();
+        const vector<const PlanNode*>::const_reverse_iterator nEnd = path.rend();
+
+        for (; nItr != nEnd; ++nItr) {
+            const PlanNode * const n = *nItr;
+            assert(steps.size() == n->parentLength);
+
+            vector<pair<size_t, FFEvent> >::const_iterator cItr = n->changedSteps.begin();
+            const vector<pair<size_t, FFEvent> >::const_iterator cEnd = n->changedSteps.end();
+            for (; cItr != cEnd; ++cItr) {
+                steps[cItr->first] = &(cItr->second);
+            }
+
+            vector<FFEvent>::const_iterator sItr = n->newSteps.begin();
+            const vector<FFEvent>::const_iterator sEnd = n->newSteps.end();
+            for (; sItr != sEnd; ++sItr) {
+                steps.push_back(&(*sItr));
+            }
+        }
+    }
+};
 
 class SearchQueueItem
 {
@@ -1553,6 +2035,14 @@ private:
     ExtendedMinimalState * internalState;
     bool ownState;
 
+    /** @brief If the item's plan is packed, it is held here rather than in <code>plan</code>: see <code>packPlan()</code>. */
+    std::shared_ptr<const PlanNode> planNode;
+
+    /** @brief The steps of <code>planNode</code>, once unpacked: successors' plans are packed as changes to these. */
+    vector<const FFEvent*> planNodeSteps;
+
+    bool planPacked;
+
 public:
 #ifdef STATEHASHDEBUG
     bool mustNotDeleteState;
@@ -1568,8 +2058,14 @@ public:
     list<ActionSegment> helpfulActions;
     FF::HTrio heuristicValue;
 
+    /** @brief Whether the item was reached by a helpful action, and queued to be evaluated later. */
+    bool preferred;
+
+    /** @brief If the item's heuristic value is yet to be evaluated (see <code>FF::deferredEvaluation</code>), what is needed to do so. */
+    unique_ptr<DeferredEvaluation> deferred;
+
     SearchQueueItem()
-            : internalState(0), ownState(false) {
+            : internalState(0), ownState(false), planPacked(false), preferred(false) {
 #ifdef STATEHASHDEBUG
         mustNotDeleteState = false;
 #endif
@@ -1586,22 +2082,63 @@ public:
      *                          is called first).
      */
     SearchQueueItem(ExtendedMinimalState * const sIn, const bool clearIfDeleted)
-            : internalState(sIn), ownState(clearIfDeleted) {
+            : internalState(sIn), ownState(clearIfDeleted), planPacked(false), preferred(false) {
 #ifdef STATEHASHDEBUG
         mustNotDeleteState = false;
 #endif
         //cout << "Created SQI at " << this << " with EMS " << sIn << endl;
     }
 
-    ~SearchQueueItem() {
-        if (ownState) {
-#ifdef STATEHASHDEBUG
-            assert(!mustNotDeleteState);
-#endif
-            delete internalState;
+    ~SearchQueueItem();
+
+    /** @brief While the item is queued, keep its plan as the changes from that of <code>parent</code>, the item it was reached from.
+     *
+     *  <code>plan</code> is left empty until <code>unpackPlan()</code> is called, when the item is popped.
+     */
+    void packPlan(SearchQueueItem * const parent) {
+        if (!parent->planNode) {
+            parent->planNode = std::make_shared<PlanNode>(parent->plan);
+            parent->planNode->getSteps(parent->planNodeSteps);
+        }
+        planNode = std::make_shared<PlanNode>(parent->planNode, parent->planNodeSteps, plan);
+        list<FFEvent>().swap(plan);
+        planPacked = true;
+    }
+
+    void unpackPlan() {
+        if (!planPacked) return;
+
+        planNode->getSteps(planNodeSteps);
+
+        vector<const FFEvent*>::const_iterator sItr = planNodeSteps.begin();
+        const vector<const FFEvent*>::const_iterator sEnd = planNodeSteps.end();
+        for (; sItr != sEnd; ++sItr) {
+            plan.push_back(*(*sItr));
         }
+        planPacked = false;
     }
 
+    /** @brief Once expanded, keep only what the successors queued for deferred evaluation need: the state, and the plan, packed.
+     *
+     *  Each time one of those successors is evaluated, the plan is unpacked for it with <code>unpackPlan()</code>, then packed
+     *  again with this.
+     */
+    void packForDeferredSuccessors() {
+        if (!planNode) {
+            planNode = std::make_shared<PlanNode>(plan);
+        }
+        list<FFEvent>().swap(plan);
+        vector<const FFEvent*>().swap(planNodeSteps);
+        list<ActionSegment>().swap(helpfulActions);
+        planPacked = true;
+    }
+
+    /** @brief Allocated from a pool, as for <code>MinimalState</code>. */
+    static void * operator new(size_t size);
+    static void operator delete(void * p, size_t size);
+
+    /** @brief Return the pool's memory to the heap, if no items are left: called once search is over. */
+    static void releasePooledMemory();
 
     /**
      *  Return the state held in this search queue item, flagging that it should not be deleted by
@@ -1645,40 +2182,190 @@ public:
 
 };
 
+/** @brief The number of steps applied to reach a state, which weighted A* uses as g unless <code>FF::timeWAStar</code>. */
+static inline int stepsToReach(const ExtendedMinimalState & e)
+{
+    const MinimalState & s = e.getInnerState();
+    return s.planLength - s.actionsExecuting - s.nextTIL;
+}
+
+/** @brief Whether a closed state reached again by <code>e</code> should be reopened, as <code>e</code> took fewer steps to reach it.
+ *
+ *  This is only done when weighted A* carries on as its weight is lowered (<code>FF::reuseSearchAcrossWeights</code>)
+ *  and g is the number of steps.  A state reached by a shorter plan is then reopened straight away, in place of ARA*'s
+ *  list of inconsistent states, so lower weights are not left with the longer path.  With g as time instead, the
+ *  existing check for reaching a state at an earlier time already does this.
+ */
+static inline bool reachedInFewerSteps(const ExtendedMinimalState & e, const int & previousSteps)
+{
+    return (FF::reuseSearchAcrossWeights && FF::WAStar && !FF::timeWAStar && stepsToReach(e) < previousSteps);
+}
+
+/**
+ *  The open list: two binary heaps, where the first is always expanded from before the second.
+ *
+ *  Each item is ordered by a primary key, then by the tie-breaks in force, then first-in first-out,
+ *  so pushing and popping are O(log n) however many items share the same primary key.
+ *
+ *  With <code>FF::preferredQueue</code>, each of the two is split in turn into regular and preferred
+ *  heaps, which are popped from alternately.
+ */
 class SearchQueue
 {
 
 private:
 
-    map<double, list<SearchQueueItem*> > qOne;
-    map<double, list<SearchQueueItem*> > qTwo;
+    /** @brief How the items in the queue are ordered, after their primary key. */
+    enum TieBreak {
+        /** @brief By <code>HTrio::operator<</code>: as used by <code>push_back()</code>, and <code>insert()</code> for cost-optimal A*. */
+        E_HTRIO_TIEBREAK,
+        /** @brief By the tie-breaks chosen for best-first search: <code>biasG</code>, then low makespan, then low cost. */
+        E_BESTFIRST_TIEBREAK
+    };
+
+    struct Entry {
+        SearchQueueItem * item;
+        double primary;
+        /** @brief When the item was queued, so items that are otherwise equal are expanded first-in first-out. */
+        unsigned long sequence;
+
+        Entry(SearchQueueItem * const itemIn, const double & primaryIn, const unsigned long & sequenceIn)
+            : item(itemIn), primary(primaryIn), sequence(sequenceIn) {
+        }
+    };
+
+    /** @brief Orders the heaps so the entry to expand next is at the front. */
+    struct ExpandLater {
+        TieBreak tieBreak;
+
+        ExpandLater(const TieBreak & t) : tieBreak(t) {
+        }
+
+        /** @brief Return <code>true</code> if <code>a</code> is to be expanded before <code>b</code>. */
+        bool expandFirst(const Entry & a, const Entry & b) const {
+            if (a.primary < b.primary) return true;
+            if (a.primary > b.primary) return false;
+
+            if (a.item->preferred != b.item->preferred) return a.item->preferred;
+
+            const FF::HTrio & aH = a.item->heuristicValue;
+            const FF::HTrio & bH = b.item->heuristicValue;
+
+            if (tieBreak == E_HTRIO_TIEBREAK || FF::biasG) {
+                if (aH < bH) return true;
+                if (bH < aH) return false;
+            }
+
+            if (tieBreak == E_BESTFIRST_TIEBREAK) {
+                if (FF::openListOrderLowMakespanFirst) {
+                    if (aH.makespanEstimate < bH.makespanEstimate) return true;
+                    if (aH.makespanEstimate > bH.makespanEstimate) return false;
+                }
+                if (FF::openListOrderLowCostFirst) {
+                    if (aH.admissibleCostEstimate < bH.admissibleCostEstimate) return true;
+                    if (aH.admissibleCostEstimate > bH.admissibleCostEstimate) return false;
+                }
+            }
+
+            return (a.sequence < b.sequence);
+        }
+
+        bool operator()(const Entry & a, const Entry & b) const {
+            return expandFirst(b, a);
+        }
+    };
+
+    vector<Entry> qOne;
+    vector<Entry> qTwo;
+
+    /** @brief If <code>FF::preferredQueue</code> is set, the items reached by helpful actions, kept apart from <code>qOne</code> and <code>qTwo</code>. */
+    vector<Entry> qOnePreferred;
+    vector<Entry> qTwoPreferred;
+
+    /** @brief How many times each of the regular and preferred queues has been popped from, less any boosts to the preferred queue. */
+    long regularTurns;
+    long preferredTurns;
+
+    TieBreak tieBreak;
+    unsigned long nextSequence;
+
+    void push(SearchQueueItem * const p, const double & primary, const int & category) {
+        SearchProfile::Timer profileTimer(SearchProfile::E_OPEN_LIST_PUSH);
+        vector<Entry> & q = (FF::preferredQueue && p->preferred ? (category == 1 ? qOnePreferred : qTwoPreferred)
+                                                                 : (category == 1 ? qOne : qTwo));
+        q.push_back(Entry(p, primary, nextSequence++));
+        std::push_heap(q.begin(), q.end(), ExpandLater(tieBreak));
+        if (SearchProfile::isEnabled()) {
+            SearchProfile::noteOpenListSize(qOne.size() + qTwo.size() + qOnePreferred.size() + qTwoPreferred.size());
+        }
+    }
+
+    SearchQueueItem * pop(vector<Entry> & q) {
+        std::pop_heap(q.begin(), q.end(), ExpandLater(tieBreak));
+        SearchQueueItem * const toReturn = q.back().item;
+        q.pop_back();
+        return toReturn;
+    }
+
+    /** @brief Pop from whichever of the regular and preferred queues has had fewer turns, allowing for boosts.
+     *
+     *  The regular queue stands in for a queue of all the items, so on its turn, the best item in either is popped.
+     */
+    SearchQueueItem * popAlternating(vector<Entry> & regular, vector<Entry> & preferred) {
+        if (preferred.empty()) {
+            return pop(regular);
+        }
+        if (regular.empty() || preferredTurns <= regularTurns) {
+            ++preferredTurns;
+            return pop(preferred);
+        }
+
+        ++regularTurns;
+        if (ExpandLater(tieBreak).expandFirst(preferred.front(), regular.front())) {
+            return pop(preferred);
+        }
+        return pop(regular);
+    }
+
+    /** @brief Switch to ordering by the given tie-break: this is only allowed when the queue is empty. */
+    void useTieBreak(const TieBreak & t) {
+        if (tieBreak != t) {
+            assert(empty());
+            tieBreak = t;
+        }
+    }
+
 public:
 
+    SearchQueue() : regularTurns(0), preferredTurns(0), tieBreak(E_HTRIO_TIEBREAK), nextSequence(0) {
+    }
+
     ~SearchQueue() {
         clear();
     }
 
     void clear() {
-        for (int pass = 0; pass < 2; ++pass) {
+        vector<Entry> * const queues[4] = {&qOne, &qTwo, &qOnePreferred, &qTwoPreferred};
 
-            map<double, list<SearchQueueItem*> > & currMap = (pass ? qTwo : qOne);
-            map<double, list<SearchQueueItem*> >::iterator cmItr = currMap.begin();
-            const map<double, list<SearchQueueItem*> >::iterator cmEnd = currMap.end();
+        for (int pass = 0; pass < 4; ++pass) {
 
-            for (; cmItr != cmEnd; ++cmItr) {
-                list<SearchQueueItem*>::iterator qItr = cmItr->second.begin();
-                const list<SearchQueueItem*>::iterator qEnd = cmItr->second.end();
+            vector<Entry> & currQueue = *(queues[pass]);
+            vector<Entry>::iterator qItr = currQueue.begin();
+            const vector<Entry>::iterator qEnd = currQueue.end();
 
-                for (; qItr != qEnd; ++qItr) delete *qItr;
-            }
-            currMap.clear();
+            for (; qItr != qEnd; ++qItr) delete qItr->item;
 
+            currQueue.clear();
         }
     }
 
+    /** @brief Pop the item to expand next, with its plan unpacked. */
     SearchQueueItem* pop_front() {
+        SearchProfile::writeIfDue();
+        SearchProfile::Timer profileTimer(SearchProfile::E_OPEN_LIST_POP);
         static int lastTime = 0;
-        if (!qOne.empty()) {
+        SearchQueueItem * toReturn;
+        if (!qOne.empty() || !qOnePreferred.empty()) {
             if (lastTime != 1) {
                 lastTime = 1;
                 if (Globals::globalVerbosity & 1) {
@@ -1686,11 +2373,7 @@ public:
                     cout.flush();
                 }
             }
-            map<double, list<SearchQueueItem*> >::iterator mItr = qOne.begin();
-            SearchQueueItem* const toReturn = mItr->second.front();
-            mItr->second.pop_front();
-            if (mItr->second.empty()) qOne.erase(mItr);
-            return toReturn;
+            toReturn = popAlternating(qOne, qOnePreferred);
         } else {
             if (lastTime != 2) {
                 lastTime = 2;
@@ -1699,55 +2382,26 @@ public:
                     cout.flush();
                 }
             }
-            map<double, list<SearchQueueItem*> >::iterator mItr = qTwo.begin();
-            SearchQueueItem* const toReturn = mItr->second.front();
-            mItr->second.pop_front();
-            if (mItr->second.empty()) qTwo.erase(mItr);
-            return toReturn;
+            toReturn = popAlternating(qTwo, qTwoPreferred);
         }
+        toReturn->unpackPlan();
+        return toReturn;
     }
 
-    SearchQueueItem * back() {
-        if (qTwo.empty()) {
-            return qOne.rbegin()->second.back();
-        } else {
-            return qTwo.rbegin()->second.back();
-        }
+    /** @brief Give the preferred queue <code>FF::preferredQueueBoost</code> extra turns: called when the best heuristic value improves. */
+    void boostPreferred() {
+        preferredTurns -= FF::preferredQueueBoost;
     }
 
     void push_back(SearchQueueItem* p, const int category = 1) {
-
-        list<SearchQueueItem*> & q = (category == 1 ? qOne[p->heuristicValue.qbreak] : qTwo[p->heuristicValue.qbreak]);
-
-        list<SearchQueueItem*>::iterator qItr = q.begin();
-        const list<SearchQueueItem*>::iterator qEnd = q.end();
-        for (; qItr != qEnd; ++qItr) {
-            if (p->heuristicValue < (*qItr)->heuristicValue) {
-                q.insert(qItr, p);
-                return;
-            }
-        }
-        q.push_back(p);
-
+        useTieBreak(E_HTRIO_TIEBREAK);
+        push(p, p->heuristicValue.qbreak, category);
     }
 
-    void insert(SearchQueueItem* p, const int category = 1) {
-
+    /** @brief The primary key for an item queued by <code>insert()</code>, given the current weight <code>FF::doubleU</code>. */
+    static double insertKey(SearchQueueItem * const p) {
         if (FF::costOptimalAStar) {
-            const double pCost = p->heuristicValue.admissibleCostEstimate;
-            list<SearchQueueItem*> & q = (category == 1 ? qOne[pCost] : qTwo[pCost]);
-
-            list<SearchQueueItem*>::iterator qItr = q.begin();
-            const list<SearchQueueItem*>::iterator qEnd = q.end();
-            for (; qItr != qEnd; ++qItr) {
-                if (p->heuristicValue < (*qItr)->heuristicValue) {
-                    q.insert(qItr, p);
-                    return;
-                }
-            }
-            q.push_back(p);
-
-            return;
+            return p->heuristicValue.admissibleCostEstimate;
         }
 
         double prim = p->heuristicValue.heuristicValue;
@@ -1756,56 +2410,35 @@ public:
             if (FF::timeWAStar) {
                 prim += p->state()->timeStamp;
             } else {
-                const int pps = p->state()->getInnerState().planLength - p->state()->getInnerState().actionsExecuting - p->state()->getInnerState().nextTIL;
-                prim += pps;
+                prim += stepsToReach(*(p->state()));
             }
         }
-        list<SearchQueueItem*> & q = (category == 1 ? qOne[prim] : qTwo[prim]);
-        if (q.empty()) {
-            q.push_back(p);
-            return;
-        }
+        return prim;
+    }
 
-        if (FF::biasG) {
-            list<SearchQueueItem*>::iterator qItr = q.begin();
-            const list<SearchQueueItem*>::iterator qEnd = q.end();
-            for (; qItr != qEnd; ++qItr) {
-                if (p->heuristicValue < (*qItr)->heuristicValue) {
-                    q.insert(qItr, p);
-                    return;
-                }
-            }
-        }
-        if (FF::openListOrderLowMakespanFirst) {
-            list<SearchQueueItem*>::iterator qItr = q.begin();
-            const list<SearchQueueItem*>::iterator qEnd = q.end();
-            for (; qItr != qEnd; ++qItr) {
-                if (p->heuristicValue.makespanEstimate < (*qItr)->heuristicValue.makespanEstimate) {
-                    q.insert(qItr, p);
-                    return;
-                }
-            }
-        }
-        if (FF::openListOrderLowCostFirst) {
-            const double pCost = p->heuristicValue.admissibleCostEstimate; // p->state()->getInnerState().calculateCost();
-            list<SearchQueueItem*>::iterator qItr = q.begin();
-            const list<SearchQueueItem*>::iterator qEnd = q.end();
-            for (; qItr != qEnd; ++qItr) {
-                if (pCost < (*qItr) ->heuristicValue.admissibleCostEstimate) {//  (*qItr)->state()->getInnerState().calculateCost()) {
-                    q.insert(qItr, p);
-                    return;
-                }
-            }
-        }
+    void insert(SearchQueueItem* p, const int category = 1) {
+        useTieBreak(FF::costOptimalAStar ? E_HTRIO_TIEBREAK : E_BESTFIRST_TIEBREAK);
+        push(p, insertKey(p), category);
+    }
+
+    /** @brief Recompute the keys of the items queued by <code>insert()</code>, after the weight <code>FF::doubleU</code> has changed. */
+    void rekey() {
+        vector<Entry> * const queues[4] = {&qOne, &qTwo, &qOnePreferred, &qTwoPreferred};
 
+        for (int pass = 0; pass < 4; ++pass) {
+            vector<Entry> & currQueue = *(queues[pass]);
+            vector<Entry>::iterator qItr = currQueue.begin();
+            const vector<Entry>::iterator qEnd = currQueue.end();
 
-        q.push_back(p);
+            for (; qItr != qEnd; ++qItr) qItr->primary = insertKey(qItr->item);
 
+            std::make_heap(currQueue.begin(), currQueue.end(), ExpandLater(tieBreak));
+        }
     }
 
 
     bool empty() const {
-        return (qOne.empty() && qTwo.empty());
+        return (qOne.empty() && qTwo.empty() && qOnePreferred.empty() && qTwoPreferred.empty());
     }
 
 };
@@ -1846,6 +2479,174 @@ void populateTimestamps(vector<double> & minTimestamps, double & makespan, list<
 
 bool FF::relaxMIP = false;
 
+namespace CSBase
+{
+
+static inline void appendSigned(string & bytes, const long long & v)
+{
+    // zig-zag encoded, so small negative values stay short
+    appendVarint(bytes, (static_cast<unsigned long long>(v) << 1) ^ static_cast<unsigned long long>(v >> 63));
+}
+
+static inline void appendDouble(string & bytes, const double & d)
+{
+    bytes.append(reinterpret_cast<const char*>(&d), sizeof(double));
+}
+
+static inline void appendDoubles(string & bytes, const vector<double> & v)
+{
+    appendVarint(bytes, v.size());
+    if (!v.empty()) {
+        bytes.append(reinterpret_cast<const char*>(&(v[0])), v.size() * sizeof(double));
+    }
+}
+
+/** @brief Pack everything <code>RPGHeuristic::getRelaxedPlan()</code> is given when evaluating <code>ae</code>.
+ *
+ *  Unlike the projections packed for the closed list, nothing is left out, and numeric values are kept exactly:
+ *  two evaluations packed to the same bytes give the same heuristic value, helpful actions and relaxed plan.
+ */
+void packHeuristicInputs(const ExtendedMinimalState & ae, const vector<double> & minTimestamps, const double & costLimit,
+                         const vector<double> & extrapolatedMin, const vector<double> & extrapolatedMax,
+                         const vector<double> & timeAtWhichValueIsDefined,
+                         const map<double, list<pair<int, int> > > * const justApplied, const double & tilFrom,
+                         string & bytes)
+{
+    const MinimalState & a = ae.getInnerState();
+
+    bytes.clear();
+
+    appendVarint(bytes, a.first.size());
+    {
+        StateFacts::const_iterator fItr = a.first.begin();
+        const StateFacts::const_iterator fEnd = a.first.end();
+        for (; fItr != fEnd; ++fItr) {
+            appendVarint(bytes, FACTA(fItr));
+            #ifndef TOTALORDERSTATES
+            // the relaxed plan is timed from when each fact became available, and when it can next be deleted
+            appendVarint(bytes, hashStep(fItr->second.availableFrom));
+            appendVarint(bytes, fItr->second.deletableFrom.size());
+            map<StepAndBeforeOrAfter, bool>::const_iterator dItr = fItr->second.deletableFrom.begin();
+            const map<StepAndBeforeOrAfter, bool>::const_iterator dEnd = fItr->second.deletableFrom.end();
+            for (; dItr != dEnd; ++dItr) {
+                appendVarint(bytes, (hashStep(dItr->first) << 1) | dItr->second);
+            }
+            #endif
+        }
+    }
+
+    #ifndef TOTALORDERSTATES
+    appendVarint(bytes, a.retired.size());
+    {
+        StateFacts::const_iterator fItr = a.retired.begin();
+        const StateFacts::const_iterator fEnd = a.retired.end();
+        for (; fItr != fEnd; ++fItr) {
+            appendVarint(bytes, FACTA(fItr));
+            appendVarint(bytes, hashStep(fItr->second.availableFrom));
+            appendVarint(bytes, fItr->second.deletableFrom.size());
+            map<StepAndBeforeOrAfter, bool>::const_iterator dItr = fItr->second.deletableFrom.begin();
+            const map<StepAndBeforeOrAfter, bool>::const_iterator dEnd = fItr->second.deletableFrom.end();
+            for (; dItr != dEnd; ++dItr) {
+                appendVarint(bytes, (hashStep(dItr->first) << 1) | dItr->second);
+            }
+        }
+    }
+    #endif
+
+    appendDoubles(bytes, a.secondMin);
+    appendDoubles(bytes, a.secondMax);
+
+    appendVarint(bytes, a.startedActions.size());
+    {
+        map<int, set<int> >::const_iterator saItr = a.startedActions.begin();
+        const map<int, set<int> >::const_iterator saEnd = a.startedActions.end();
+        for (; saItr != saEnd; ++saItr) {
+            appendVarint(bytes, saItr->first);
+            appendAscending(bytes, saItr->second.size(), saItr->second.begin(), saItr->second.end());
+        }
+    }
+
+    appendVarint(bytes, a.preferenceStatus.size());
+    {
+        const int prefCount = a.preferenceStatus.size();
+        for (int p = 0; p < prefCount; ++p) {
+            appendVarint(bytes, a.preferenceStatus[p]);
+        }
+    }
+    appendDouble(bytes, a.prefPreconditionViolations);
+
+    if (a.lowerBoundOnTimeDependentRewardFacts) {
+        const int tdrFactCount = NumericAnalysis::getFactsInTimeDependentRewards().size();
+        appendVarint(bytes, tdrFactCount);
+        for (int f = 0; f < tdrFactCount; ++f) {
+            appendDouble(bytes, a.lowerBoundOnTimeDependentRewardFacts[f]);
+        }
+    } else {
+        appendVarint(bytes, 0);
+    }
+
+    appendSigned(bytes, a.nextTIL);
+    appendVarint(bytes, a.planLength);
+
+    if (a.temporalConstraints) {
+        const vector<FluentInteraction> & lastStepToTouchPNE = a.temporalConstraints->lastStepToTouchPNE;
+        const int pneCount = lastStepToTouchPNE.size();
+        appendVarint(bytes, pneCount);
+        for (int i = 0; i < pneCount; ++i) {
+            appendSigned(bytes, lastStepToTouchPNE[i].lastInstantaneousEffect);
+        }
+    } else {
+        appendVarint(bytes, 0);
+    }
+
+    appendVarint(bytes, ae.startEventQueue.size());
+    {
+        list<StartEvent>::const_iterator evItr = ae.startEventQueue.begin();
+        const list<StartEvent>::const_iterator evEnd = ae.startEventQueue.end();
+        for (; evItr != evEnd; ++evItr) {
+            appendVarint(bytes, evItr->actID);
+            appendSigned(bytes, evItr->divisionsApplied);
+            appendSigned(bytes, evItr->stepID);
+            appendVarint(bytes, (evItr->terminated ? 1 : 0) | (evItr->ignore ? 2 : 0));
+            appendDouble(bytes, evItr->advancingDuration);
+            appendDouble(bytes, evItr->minDuration);
+            appendDouble(bytes, evItr->maxDuration);
+            appendDouble(bytes, evItr->elapsed);
+            appendDouble(bytes, evItr->minAdvance);
+            appendDouble(bytes, evItr->lpMinTimestamp);
+            appendDouble(bytes, evItr->lpMaxTimestamp);
+        }
+    }
+
+    appendDouble(bytes, ae.timeStamp);
+    appendDoubles(bytes, minTimestamps);
+    appendDouble(bytes, costLimit);
+    appendDoubles(bytes, extrapolatedMin);
+    appendDoubles(bytes, extrapolatedMax);
+    appendDoubles(bytes, timeAtWhichValueIsDefined);
+
+    if (justApplied) {
+        appendVarint(bytes, justApplied->size() + 1);
+        map<double, list<pair<int, int> > >::const_iterator jaItr = justApplied->begin();
+        const map<double, list<pair<int, int> > >::const_iterator jaEnd = justApplied->end();
+        for (; jaItr != jaEnd; ++jaItr) {
+            appendDouble(bytes, jaItr->first);
+            appendVarint(bytes, jaItr->second.size());
+            list<pair<int, int> >::const_iterator aItr = jaItr->second.begin();
+            const list<pair<int, int> >::const_iterator aEnd = jaItr->second.end();
+            for (; aItr != aEnd; ++aItr) {
+                appendSigned(bytes, aItr->first);
+                appendSigned(bytes, aItr->second);
+            }
+        }
+    } else {
+        appendVarint(bytes, 0);
+    }
+    appendDouble(bytes, tilFrom);
+}
+
+};
+
 FF::HTrio FF::calculateHeuristicAndSchedule(ExtendedMinimalState & theState, ExtendedMinimalState * prevState, set<int> & goals, set<int> & goalFluents,
                                             ParentData * const incrementalData, list<ActionSegment> & helpfulActions, pair<bool,double> & currentCost,
                                             list<FFEvent> & header, list<FFEvent> & now, const int & stepID, bool considerCache, map<double, list<pair<int, int> > > * justApplied, double tilFrom)
@@ -1884,12 +2685,12 @@ FF::HTrio FF::calculateHeuristicAndSchedule(ExtendedMinimalState & theState, Ext
 
     vector<double> timeAtWhichValueIsDefined;
 
-    tryToSchedule.removeExpiredAbstractFacts(theState.getEditableInnerState().first);
+    tryToSchedule.removeExpiredAbstractFacts(theState.getEditableInnerState());
     tryToSchedule.updateStateFluents(theState.getEditableInnerState().secondMin, theState.getEditableInnerState().secondMax, timeAtWhichValueIsDefined);
 
     #ifdef SCHEDULETWICE
     vector<double> timeAtWhichValueIsDefinedAgain;
-    tryToScheduleAgain.removeExpiredAbstractFacts(scheduleTwiceState.first);
+    tryToScheduleAgain.removeExpiredAbstractFacts(scheduleTwiceState);
     tryToScheduleAgain.updateStateFluents(scheduleTwiceState.secondMin, scheduleTwiceState.secondMax, timeAtWhichValueIsDefinedAgain);
     #endif
 
@@ -1974,31 +2775,41 @@ FF::HTrio FF::calculateHeuristicAndSchedule(ExtendedMinimalState & theState, Ext
     list<pair<double, list<ActionSegment> > > relaxedPlan;
 
     //printState(theState);
-    static int oldBestH = INT_MAX;
 
     unique_ptr<RPGHeuristic::EvaluationInfo> h(nullptr);
     double makespanEstimate = 0.0;
-    if (considerCache) {
-        if (FFcache_upToDate) {
-            relaxedPlan = FFcache_relaxedPlan;
-            helpfulActions.insert(helpfulActions.end(), FFcache_helpfulActions.begin(), FFcache_helpfulActions.end());
-            h = unique_ptr<RPGHeuristic::EvaluationInfo>(new RPGHeuristic::EvaluationInfo(FFcache_h));
-            makespanEstimate = FFcache_makespanEstimate;
-            cout << "*";
-            cout.flush();
+    if (considerCache && FF::heuristicCacheEntries) {
+        string & cacheKey = context().heuristicCacheKey;
+        CSBase::packHeuristicInputs(theState, minTimestamps, costLimit, extrapolatedMin, extrapolatedMax, timeAtWhichValueIsDefined,
+                                    justApplied, tilFrom, cacheKey);
+
+        const HeuristicCache::Entry * const cached = context().heuristicCache->find(cacheKey);
+        if (cached) {
+            relaxedPlan = cached->relaxedPlan;
+            helpfulActions.insert(helpfulActions.end(), cached->helpfulActions.begin(), cached->helpfulActions.end());
+            h = unique_ptr<RPGHeuristic::EvaluationInfo>(new RPGHeuristic::EvaluationInfo(cached->h));
+            makespanEstimate = cached->makespanEstimate;
+            if (Globals::globalVerbosity & 1) {
+                cout << "*";
+                cout.flush();
+            }
         } else {
             if (evaluationDiagnostics) {
                 cout << COLOUR_yellow << "\tGetting a relaxed plan\n" << COLOUR_default << endl;
             }
+            const size_t helpfulActionsBefore = helpfulActions.size();
+
             h = unique_ptr<RPGHeuristic::EvaluationInfo>(RPGBuilder::getHeuristic()->getRelaxedPlan(theState.getEditableInnerState(), &(theState.startEventQueue), minTimestamps, theState.timeStamp, costLimit,
                                                                                                    extrapolatedMin, extrapolatedMax, timeAtWhichValueIsDefined,                                  // for colin-jair heuristic
                                                                                                    helpfulActions, relaxedPlan, makespanEstimate, justApplied, tilFrom));
 
-            FFcache_relaxedPlan = relaxedPlan;
-            FFcache_helpfulActions = helpfulActions;
-            FFcache_h = RPGHeuristic::EvaluationInfo(*(h.get()));
-            FFcache_makespanEstimate = makespanEstimate;
-            FFcache_upToDate = true;
+            HeuristicCache::Entry & toCache = context().heuristicCache->insert(cacheKey);
+            toCache.relaxedPlan = relaxedPlan;
+            list<ActionSegment>::iterator newHelpful = helpfulActions.begin();
+            std::advance(newHelpful, helpfulActionsBefore);
+            toCache.helpfulActions.assign(newHelpful, helpfulActions.end());
+            toCache.h = RPGHeuristic::EvaluationInfo(*(h.get()));
+            toCache.makespanEstimate = makespanEstimate;
         }
     } else {
         //printState(theState);
@@ -2014,9 +2825,6 @@ FF::HTrio FF::calculateHeuristicAndSchedule(ExtendedMinimalState & theState, Ext
 
     if (h->getH() < 0) return HTrio(-1.0, DBL_MAX, DBL_MAX, INT_MAX, "RPG heuristic detected a deadend");
 
-    if (h->getH() < oldBestH) {
-        oldBestH = h->getH();
-    }
 
 
 
@@ -2031,13 +2839,13 @@ FF::HTrio FF::calculateHeuristicAndSchedule(ExtendedMinimalState & theState, Ext
         if (!RPGHeuristic::blindSearch) {
             cycle = !tryToSchedule.addRelaxedPlan(theState.startEventQueue, theState.getEditableInnerState().preferenceStatus, theState.getEditableInnerState().prefPreconditionViolations, header, now, relaxedPlan, stepID);
             if (!cycle) {
-                tryToSchedule.removeExpiredAbstractFacts(theState.getEditableInnerState().first);
+                tryToSchedule.removeExpiredAbstractFacts(theState.getEditableInnerState());
             }
 
             #ifdef SCHEDULETWICE
             tryToScheduleAgain.addRelaxedPlan(theState.startEventQueue, scheduleTwiceState.preferenceStatus, scheduleTwiceState.prefPreconditionViolations, header, now, relaxedPlan, stepID);
             if (!cycle) {
-                tryToScheduleAgain.removeExpiredAbstractFacts(scheduleTwiceState.first);
+                tryToScheduleAgain.removeExpiredAbstractFacts(scheduleTwiceState);
             }
 
             #endif
@@ -2177,7 +2985,6 @@ FF::HTrio FF::calculateHeuristicAndCompressionSafeSchedule(ExtendedMinimalState
     list<pair<double, list<ActionSegment> > > relaxedPlan;
 
     //printState(theState);
-    static int oldBestH = INT_MAX;
 
     double makespanEstimate = 0.0;
     unique_ptr<RPGHeuristic::EvaluationInfo> h(RPGBuilder::getHeuristic()->getRelaxedPlan(theState.getEditableInnerState(), &(theState.startEventQueue), minTimestamps, theState.timeStamp, -DBL_MAX,
@@ -2186,9 +2993,6 @@ FF::HTrio FF::calculateHeuristicAndCompressionSafeSchedule(ExtendedMinimalState
 
     if (h->getH() < 0) return HTrio(-1.0, DBL_MAX, DBL_MAX, INT_MAX, "RPG heuristic detected a deadend");
 
-    if (h->getH() < oldBestH) {
-        oldBestH = h->getH();
-    }
 
 
 
@@ -2201,6 +3005,7 @@ FF::HTrio FF::calculateHeuristicAndCompressionSafeSchedule(ExtendedMinimalState
 
 ExtendedMinimalState * FF::applyActionToState(ActionSegment & actionToApply, const ExtendedMinimalState & parent, const list<FFEvent> & plan, list<pair<int, FFEvent> > & newDummySteps)
 {
+    SearchProfile::Timer profileTimer(SearchProfile::E_APPLY_ACTION);
 
 //  static const double EPSILON = 0.001;
     const bool localDebug = false;
@@ -2536,6 +3341,35 @@ bool FF::stateHasProgressedBeyondItsParent(const ActionSegment & theAction, cons
 }
 
 
+static FixedSizePool & extendedMinimalStatePool()
+{
+    static FixedSizePool * const pool = new FixedSizePool(sizeof(ExtendedMinimalState));
+    return *pool;
+}
+
+void * ExtendedMinimalState::operator new(size_t size)
+{
+    if (size != sizeof(ExtendedMinimalState)) {
+        return ::operator new(size);
+    }
+    return extendedMinimalStatePool().allocate();
+}
+
+void ExtendedMinimalState::operator delete(void * p, size_t size)
+{
+    if (!p) return;
+    if (size != sizeof(ExtendedMinimalState)) {
+        ::operator delete(p);
+        return;
+    }
+    extendedMinimalStatePool().deallocate(p);
+}
+
+void ExtendedMinimalState::releasePooledMemory()
+{
+    extendedMinimalStatePool().releaseIfUnused();
+}
+
 void ExtendedMinimalState::deQueueFirstOf(const int & actID, const int & divID)
 {
 
@@ -2833,7 +3667,6 @@ void FF::evaluateStateAndUpdatePlan(unique_ptr<SearchQueueItem> & succ,
     }
 
 
-    FFcache_upToDate = false;
 
     list<FFEvent> nowList;
 
@@ -2975,47 +3808,10 @@ bool FF::precedingActions(ExtendedMinimalState & theState, const ActionSegment &
 
 //  static const double EPSILON = 0.001;
     static const bool tsDebug = false;
-    static vector<double> tilStamps;
-    static vector<list<int> > tilNegativeEffects;
-    static vector<list<int> > tilPermanentNegativeEffects;
-    static int tilCount;
-    static bool haveTILstamps = false;
-
-    if (!haveTILstamps) {
-        haveTILstamps = true;
-        vector<RPGBuilder::FakeTILAction*> & tilVec = RPGBuilder::getNonAbstractedTILVec();
-        tilCount = tilVec.size();
-        tilStamps = vector<double>(tilCount);
-        tilNegativeEffects = vector<list<int> >(tilCount);
-        tilPermanentNegativeEffects = vector<list<int> >(tilCount);
-        set<int> addedLater;
-        for (int i = tilCount - 1; i >= 0; --i) {
-            tilStamps[i] = tilVec[i]->duration;
-            {
-                list<Literal*>::iterator effItr = tilVec[i]->addEffects.begin();
-                const list<Literal*>::iterator effEnd = tilVec[i]->addEffects.end();
-
-                for (; effItr != effEnd; ++effItr) {
-                    const int currEffID = (*effItr)->getStateID();
-                    //tilEffects[i].push_back(currEffID);
-                    addedLater.insert(currEffID);
-                }
-            }
-
-            {
-                list<Literal*>::iterator effItr = tilVec[i]->delEffects.begin();
-                const list<Literal*>::iterator effEnd = tilVec[i]->delEffects.end();
-
-                for (; effItr != effEnd; ++effItr) {
-                    const int currEffID = (*effItr)->getStateID();
-                    tilNegativeEffects[i].push_back(currEffID);
-                    if (RPGBuilder::getEffectsToActions(currEffID).empty() && addedLater.find(currEffID) == addedLater.end()) {
-                        tilPermanentNegativeEffects[i].push_back(currEffID);
-                    }
-                }
-            }
-        }
-    }
+    FF::SearchContext & c = context();
+    summariseTILs(c);
+    const vector<double> & tilStamps = c.tilStamps;
+    const int & tilCount = c.tilCount;
 
 
     const Planner::time_spec ts = actionSeg.second;
@@ -3152,6 +3948,7 @@ bool FF::precedingActions(ExtendedMinimalState & theState, const ActionSegment &
 
 bool FF::checkTemporalSoundness(ExtendedMinimalState * prevState, ExtendedMinimalState & theState, const ActionSegment & actionSeg, const int oldTIL, const double moveOn)
 {
+    SearchProfile::Timer profileTimer(SearchProfile::E_TEMPORAL_SOUNDNESS);
 
     //const int & theAction, const Planner::time_spec & ts
 
@@ -3159,47 +3956,12 @@ bool FF::checkTemporalSoundness(ExtendedMinimalState * prevState, ExtendedMinima
     if (!tsChecking) return true;
 
     static const bool tsDebug = (Globals::globalVerbosity & 8192);
-    static vector<double> tilStamps;
-    static vector<list<int> > tilNegativeEffects;
-    static vector<list<int> > tilPermanentNegativeEffects;
-    static int tilCount;
-    static bool haveTILstamps = false;
-
-    if (!haveTILstamps) {
-        haveTILstamps = true;
-        vector<RPGBuilder::FakeTILAction*> & tilVec = RPGBuilder::getNonAbstractedTILVec();
-        tilCount = tilVec.size();
-        tilStamps = vector<double>(tilCount);
-        tilNegativeEffects = vector<list<int> >(tilCount);
-        tilPermanentNegativeEffects = vector<list<int> >(tilCount);
-        set<int> addedLater;
-        for (int i = tilCount - 1; i >= 0; --i) {
-            tilStamps[i] = tilVec[i]->duration;
-            {
-                list<Literal*>::iterator effItr = tilVec[i]->addEffects.begin();
-                const list<Literal*>::iterator effEnd = tilVec[i]->addEffects.end();
-
-                for (; effItr != effEnd; ++effItr) {
-                    const int currEffID = (*effItr)->getStateID();
-                    //tilEffects[i].push_back(currEffID);
-                    addedLater.insert(currEffID);
-                }
-            }
-
-            {
-                list<Literal*>::iterator effItr = tilVec[i]->delEffects.begin();
-                const list<Literal*>::iterator effEnd = tilVec[i]->delEffects.end();
-
-                for (; effItr != effEnd; ++effItr) {
-                    const int currEffID = (*effItr)->getStateID();
-                    tilNegativeEffects[i].push_back(currEffID);
-                    if (RPGBuilder::getEffectsToActions(currEffID).empty() && addedLater.find(currEffID) == addedLater.end()) {
-                        tilPermanentNegativeEffects[i].push_back(currEffID);
-                    }
-                }
-            }
-        }
-    }
+    FF::SearchContext & c = context();
+    summariseTILs(c);
+    const vector<double> & tilStamps = c.tilStamps;
+    const vector<list<int> > & tilNegativeEffects = c.tilNegativeEffects;
+    const vector<list<int> > & tilPermanentNegativeEffects = c.tilPermanentNegativeEffects;
+    const int & tilCount = c.tilCount;
 
 
     const Planner::time_spec ts = actionSeg.second;
@@ -4305,24 +5067,29 @@ void reorderHelpfulFirst(list<ActionSegment> & applicableActions, list<ActionSeg
 
 };
 
+/** @brief Whether <code>a</code> is one of <code>helpfulActions</code>. */
+bool isHelpfulAction(const ActionSegment & a, const list<ActionSegment> & helpfulActions)
+{
+    list<ActionSegment>::const_iterator hItr = helpfulActions.begin();
+    const list<ActionSegment>::const_iterator hEnd = helpfulActions.end();
+
+    for (; hItr != hEnd; ++hItr) {
+        if (a.first == hItr->first && a.second == hItr->second && a.divisionID == hItr->divisionID) {
+            return true;
+        }
+    }
+    return false;
+}
+
 
 void FF::makeJustApplied(map<double, list<pair<int, int> > > & justApplied, double & tilFrom, ExtendedMinimalState & state, const bool & lastIsSpecial)
 {
 
     static const bool debugJA = false;
-    static vector<double> tilStamps;
-    static int tilCount;
-    static bool haveTILstamps = false;
-
-    if (!haveTILstamps) {
-        haveTILstamps = true;
-        vector<RPGBuilder::FakeTILAction*> & tilVec = RPGBuilder::getNonAbstractedTILVec();
-        tilCount = tilVec.size();
-        tilStamps = vector<double>(tilCount);
-        for (int i = 0; i < tilCount; ++i) {
-            tilStamps[i] = tilVec[i]->duration;
-        }
-    }
+    FF::SearchContext & c = context();
+    summariseTILs(c);
+    const vector<double> & tilStamps = c.tilStamps;
+    const int & tilCount = c.tilCount;
 
     tilFrom = EPSILON;
 
@@ -4556,8 +5323,46 @@ public:
 
 };
 
-typedef map<ExtendedMinimalState*, double, SecondaryExtendedStateLessThan> InnerMap;
-typedef map<ExtendedMinimalState*, pair<double, InnerMap>, WeakExtendedStateLessThan> OuterMap;
+/** @brief A closed state, as it differs from others on its secondary projection: see <code>CSBase::packSecondaryProjection</code>. */
+struct PackedSecondaryState {
+    unsigned long long hash;
+    string bytes;
+    double timestamp;
+    /** @brief The fewest steps it has been reached by: see <code>stepsToReach()</code>. */
+    int steps;
+
+    PackedSecondaryState(const unsigned long long & h, const double & t, const int & s)
+        : hash(h), timestamp(t), steps(s) {
+    }
+};
+
+/** @brief A closed state, on its weak projection, which is kept packed as its key in a <code>PackedStateBucket</code>.
+ *
+ *  The full state is not kept: once expanded, it is deleted along with its search queue item.
+ */
+struct PackedState {
+    double timestamp;
+    std::forward_list<PackedSecondaryState> secondary;
+
+    PackedState(const double & t)
+        : timestamp(t) {
+    }
+};
+
+struct PackedWeakProjectionLessThan {
+    bool operator()(const string & a, const string & b) const {
+        return (CSBase::comparePackedWeakProjections(a, b) < 0);
+    }
+};
+
+/** @brief The closed states with the same <code>CSBase::weakHash</code>, by their packed weak projections.
+ *
+ *  The hash leaves out numeric values, as these are compared to within a tolerance, so in numeric domains
+ *  many states can share a bucket: ordering them keeps each lookup logarithmic in the bucket's size.
+ */
+typedef map<string, PackedState, PackedWeakProjectionLessThan> PackedStateBucket;
+
+typedef std::unordered_map<unsigned long long, PackedStateBucket> PackedStateBuckets;
 
 class StateHash {
 
@@ -4572,10 +5377,12 @@ public:
         virtual ~InsertIterator() {
         }
 
+        /** @brief Record the timestamp of <code>e</code>, the state kept, and the number of steps taken to reach it, if fewer than before. */
         virtual void setTimestampOfThisState(const ExtendedMinimalState * const e) = 0;
         virtual bool primaryNewState() const = 0;
         virtual bool secondaryNewState() const = 0;
         virtual double previousTimestamp() const = 0;
+        virtual int previousSteps() const = 0;
     };
 
     class FindIterator {
@@ -4590,16 +5397,77 @@ public:
         virtual bool primaryNewState() const = 0;
         virtual bool secondaryNewState() const = 0;
         virtual double previousTimestamp() const = 0;
+        virtual int previousSteps() const = 0;
 
     };
 
-    virtual InsertIterator * insertState(SearchQueueItem * const s, StatesToDelete * const keptStates)  __attribute__((warn_unused_result)) = 0;
+    /** @brief Insert the state of <code>s</code>.
+     *
+     *  If given, <code>lookedUp</code> must have come from <code>findState()</code> on this hash: if it was
+     *  a lookup of the same state, the hash may reuse the work done then.
+     */
+    virtual InsertIterator * insertState(SearchQueueItem * const s, StatesToDelete * const keptStates, FindIterator * const lookedUp = 0)  __attribute__((warn_unused_result)) = 0;
     virtual InsertIterator * insertState(ExtendedMinimalState * const e)  __attribute__((warn_unused_result)) = 0;
     virtual FindIterator* findState(ExtendedMinimalState * const e) const   __attribute__((warn_unused_result)) = 0;
     virtual void clear() = 0;
 };
 
-class NormalStateHash : protected OuterMap, public StateHash
+/** @brief What is needed to evaluate a state queued without its heuristic value having been computed. */
+struct DeferredEvaluation {
+    /** @brief The item the state was reached from, kept until all the states reached from it have been evaluated.
+     *
+     *  Once expanded, the item keeps its plan packed: see <code>SearchQueueItem::packForDeferredSuccessors()</code>.
+     */
+    std::shared_ptr<SearchQueueItem> parent;
+    ActionSegment action;
+    list<pair<int, FFEvent> > newDummySteps;
+    /** @brief The state's entry in the closed list, to update with its timestamp once evaluated. */
+    unique_ptr<StateHash::InsertIterator> closedListEntry;
+
+    DeferredEvaluation(const std::shared_ptr<SearchQueueItem> & parentIn, const ActionSegment & actionIn,
+                       const list<pair<int, FFEvent> > & newDummyStepsIn, StateHash::InsertIterator * const closedListEntryIn)
+        : parent(parentIn), action(actionIn), newDummySteps(newDummyStepsIn), closedListEntry(closedListEntryIn) {
+    }
+};
+
+SearchQueueItem::~SearchQueueItem()
+{
+    if (ownState) {
+#ifdef STATEHASHDEBUG
+        assert(!mustNotDeleteState);
+#endif
+        delete internalState;
+    }
+}
+
+static FixedSizePool & searchQueueItemPool()
+{
+    static FixedSizePool * const pool = new FixedSizePool(sizeof(SearchQueueItem));
+    return *pool;
+}
+
+void * SearchQueueItem::operator new(size_t)
+{
+    return searchQueueItemPool().allocate();
+}
+
+void SearchQueueItem::operator delete(void * p, size_t)
+{
+    if (p) searchQueueItemPool().deallocate(p);
+}
+
+void SearchQueueItem::releasePooledMemory()
+{
+    searchQueueItemPool().releaseIfUnused();
+}
+
+/** @brief The closed list used unless dominance constraints are in use.
+ *
+ *  States are kept packed into byte strings of the parts compared when detecting duplicates, in buckets
+ *  by <code>CSBase::weakHash</code> and <code>CSBase::secondaryHash</code>.  As the hash keeps none of
+ *  the states it is given, these remain owned by their search queue items.
+ */
+class NormalStateHash : protected PackedStateBuckets, public StateHash
 {
 
 public:
@@ -4609,31 +5477,41 @@ public:
     friend class NormalStateHash;
 
     protected:
-        pair<OuterMap::iterator, bool> outerInsertion;
-        pair<InnerMap::iterator, bool> innerInsertion;
+        PackedState * primary;
+        PackedSecondaryState * secondary;
+        bool primaryNew;
+        bool secondaryNew;
 
     public:
-        InsertIterator() {
+        InsertIterator()
+            : primary(0), secondary(0), primaryNew(false), secondaryNew(false) {
         }
 
         virtual void setTimestampOfThisState(const ExtendedMinimalState * const e) {
             const double & t = e->timeStamp;
 
-            double & previousTS = outerInsertion.first->second.first;
-            if (previousTS > t) {
-                previousTS = t;
+            if (primary->timestamp > t) {
+                primary->timestamp = t;
+            }
+            secondary->timestamp = t;
+
+            const int steps = stepsToReach(*e);
+            if (secondary->steps > steps) {
+                secondary->steps = steps;
             }
-            innerInsertion.first->second = t;
         }
 
         virtual bool primaryNewState() const {
-            return outerInsertion.second;
+            return primaryNew;
         }
         virtual bool secondaryNewState() const {
-            return innerInsertion.second;
+            return secondaryNew;
         }
         virtual double previousTimestamp() const {
-            return innerInsertion.first->second;
+            return secondary->timestamp;
+        }
+        virtual int previousSteps() const {
+            return secondary->steps;
         }
 
     };
@@ -4643,93 +5521,160 @@ public:
     friend class NormalStateHash;
 
     protected:
-        OuterMap::const_iterator outerFind;
-        InnerMap::const_iterator innerFind;
+        const PackedState * primary;
+        const PackedSecondaryState * secondary;
 
-        OuterMap::const_iterator outerEnd;
-        InnerMap::const_iterator innerEnd;
+        /** @brief The state looked up, and what it was hashed and packed to, for <code>insertState()</code> to reuse. */
+        const ExtendedMinimalState * const state;
+        unsigned long long weakHash;
+        bool weakPacked;
+        string weakBytes;
+        bool secondaryPacked;
+        unsigned long long secondaryHash;
+        string secondaryBytes;
 
-        FindIterator(const OuterMap::const_iterator & itr, const OuterMap::const_iterator & itrEnd)
-                : outerFind(itr), outerEnd(itrEnd) {
+        FindIterator(const ExtendedMinimalState * const e)
+            : primary(0), secondary(0), state(e), weakHash(CSBase::weakHash(*e)), weakPacked(false),
+              secondaryPacked(false), secondaryHash(0) {
+        }
+
+        void packWeak() {
+            if (!weakPacked) {
+                CSBase::packWeakProjection(*state, weakBytes);
+                weakPacked = true;
+            }
+        }
+
+        void packSecondary() {
+            if (!secondaryPacked) {
+                secondaryHash = CSBase::secondaryHash(*state);
+                CSBase::packSecondaryProjection(*state, secondaryBytes);
+                secondaryPacked = true;
+            }
         }
 
     public:
         virtual bool primaryNewState() const {
-            return (outerFind == outerEnd);
+            return !primary;
         }
         virtual bool secondaryNewState() const {
-            return (innerFind == innerEnd);
+            return !secondary;
         }
         virtual double previousTimestamp() const {
-            return innerFind->second;
+            return secondary->timestamp;
+        }
+        virtual int previousSteps() const {
+            return secondary->steps;
         }
     };
 
-    NormalStateHash() {
+protected:
+
+    /** @brief How many states are kept, for the search profile's peak closed list size. */
+    size_t storedStates;
+
+    /** @brief Find the packed state matching the weak projection packed in <code>weakBytes</code>, if any. */
+    static const PackedState * findPrimary(const string & weakBytes, const PackedStateBucket & bucket) {
+        const PackedStateBucket::const_iterator pItr = bucket.find(weakBytes);
+        if (pItr == bucket.end()) {
+            return 0;
+        }
+        return &(pItr->second);
     }
 
-    ~NormalStateHash() {
+    /** @brief Find the packed secondary state with the given hash and packed secondary projection, if any. */
+    static const PackedSecondaryState * findSecondary(const unsigned long long & hash, const string & secondaryBytes, const PackedState & primary) {
+        std::forward_list<PackedSecondaryState>::const_iterator sItr = primary.secondary.begin();
+        const std::forward_list<PackedSecondaryState>::const_iterator sEnd = primary.secondary.end();
+        for (; sItr != sEnd; ++sItr) {
+            if (sItr->hash == hash && sItr->bytes == secondaryBytes) {
+                return &(*sItr);
+            }
+        }
+        return 0;
     }
 
-    virtual InsertIterator * insertState(SearchQueueItem * const s, StatesToDelete * const keptStates)  __attribute__((warn_unused_result)) {
-        static InnerMap emptyInner;
+    /** @brief Insert <code>e</code>, reusing the hashes and packing of <code>lookedUp</code> if it was a lookup of <code>e</code>.
+     *
+     *  A state's projections are not changed between looking it up and inserting it, only its timestamp
+     *  and temporal constraints, so the lookup's work need not be repeated.
+     */
+    InsertIterator * insertHashedState(ExtendedMinimalState * const e, StateHash::FindIterator * const lookedUp)  __attribute__((warn_unused_result)) {
+        SearchProfile::Timer profileTimer(SearchProfile::E_STATE_HASH_INSERT);
         InsertIterator* const toReturn = new InsertIterator();
 
-        toReturn->outerInsertion = insert(make_pair(s->state(), make_pair(s->state()->timeStamp, emptyInner)));
-        toReturn->innerInsertion = toReturn->outerInsertion.first->second.second.insert(make_pair(s->state(), s->state()->timeStamp));
+        FindIterator * previous = static_cast<FindIterator*>(lookedUp);
+        unique_ptr<FindIterator> fresh;
+        if (!previous || previous->state != e) {
+            fresh.reset(new FindIterator(e));
+            previous = fresh.get();
+        }
 
+        PackedStateBucket & bucket = (*this)[previous->weakHash];
 
-        if (toReturn->outerInsertion.second || toReturn->innerInsertion.second) {
-            keptStates->alsoCleanUp(s);
-#ifdef STATEHASHDEBUG
-            s->mustNotDeleteState = true;
-#endif
+        previous->packWeak();
+        toReturn->primary = const_cast<PackedState*>(findPrimary(previous->weakBytes, bucket));
+        if (!toReturn->primary) {
+            toReturn->primary = &(bucket.insert(std::make_pair(previous->weakBytes, PackedState(e->timeStamp))).first->second);
+            toReturn->primaryNew = true;
         }
 
-        return toReturn;
+        previous->packSecondary();
+        toReturn->secondary = const_cast<PackedSecondaryState*>(findSecondary(previous->secondaryHash, previous->secondaryBytes, *(toReturn->primary)));
+        if (!toReturn->secondary) {
+            toReturn->primary->secondary.push_front(PackedSecondaryState(previous->secondaryHash, e->timeStamp, stepsToReach(*e)));
+            toReturn->secondary = &(toReturn->primary->secondary.front());
+            toReturn->secondary->bytes.swap(previous->secondaryBytes);
+            previous->secondaryPacked = false;
+            toReturn->secondaryNew = true;
+            SearchProfile::noteClosedListSize(++storedStates);
+        }
 
+        return toReturn;
     }
 
-    virtual InsertIterator * insertState(ExtendedMinimalState * const e)  __attribute__((warn_unused_result)) {
-        static InnerMap emptyInner;
-        InsertIterator* const toReturn = new InsertIterator();
-
-        toReturn->outerInsertion = insert(make_pair(e, make_pair(e->timeStamp, emptyInner)));
+public:
 
-#ifdef STATEHASHDEBUG
-        /*if (toReturn.outerInsertion.second) {
-            cout << "State " << e << " is new in the outer set\n";
-        }*/
-#endif
+    NormalStateHash() : storedStates(0) {
+    }
 
-        toReturn->innerInsertion = toReturn->outerInsertion.first->second.second.insert(make_pair(e, e->timeStamp));
+    ~NormalStateHash() {
+    }
 
-#ifdef STATEHASHDEBUG
-        /*if (toReturn.innerInsertion.second) {
-            cout << "State " << e << " is new in the inner set\n";
-        }*/
-#endif
+    virtual InsertIterator * insertState(SearchQueueItem * const s, StatesToDelete * const, StateHash::FindIterator * const lookedUp)  __attribute__((warn_unused_result)) {
+        return insertHashedState(s->state(), lookedUp);
+    }
 
-        return toReturn;
+    virtual InsertIterator * insertState(ExtendedMinimalState * const e)  __attribute__((warn_unused_result)) {
+        return insertHashedState(e, 0);
     }
 
 
     virtual FindIterator* findState(ExtendedMinimalState * const e) const   __attribute__((warn_unused_result)) {
-        FindIterator * const toReturn = new FindIterator(this->OuterMap::find(e), this->OuterMap::end());
-        if (toReturn->outerFind != end()) {
-            toReturn->innerFind = toReturn->outerFind->second.second.find(e);
-            toReturn->innerEnd = toReturn->outerFind->second.second.end();
+        SearchProfile::Timer profileTimer(SearchProfile::E_STATE_HASH_LOOKUP);
+        FindIterator * const toReturn = new FindIterator(e);
+
+        const PackedStateBuckets::const_iterator bucket = this->PackedStateBuckets::find(toReturn->weakHash);
+        if (bucket != this->PackedStateBuckets::end()) {
+            toReturn->packWeak();
+            toReturn->primary = findPrimary(toReturn->weakBytes, bucket->second);
+            if (toReturn->primary) {
+                toReturn->packSecondary();
+                toReturn->secondary = findSecondary(toReturn->secondaryHash, toReturn->secondaryBytes, *(toReturn->primary));
+            }
         }
         return toReturn;
     }
 
     virtual void clear() {
-        this->OuterMap::clear();
+        this->PackedStateBuckets::clear();
+        storedStates = 0;
     }
 
 };
 
-typedef map<ExtendedMinimalState*, double, FullExtendedStateLessThan> InnerDominanceMap;
+/** @brief The timestamp of each state kept, and the fewest steps it has been reached by: see <code>stepsToReach()</code>. */
+typedef map<ExtendedMinimalState*, pair<double, int>, FullExtendedStateLessThan> InnerDominanceMap;
 
 struct ParetoStatesAndOthers {
 
@@ -4749,6 +5694,9 @@ private:
     static vector<bool> thatVarIsBiggerBetter;
     static int numberOfVarsWithDominanceConstraints;
 
+    /** @brief How many states are kept, for the search profile's peak closed list size. */
+    size_t storedStates;
+
 public:
 
     class InsertIterator : public StateHash::InsertIterator {
@@ -4773,7 +5721,12 @@ public:
                     previousTS = t;
                 }
             }
-            innerInsertion.first->second = t;
+            innerInsertion.first->second.first = t;
+
+            const int steps = stepsToReach(*e);
+            if (innerInsertion.first->second.second > steps) {
+                innerInsertion.first->second.second = steps;
+            }
         }
 
         virtual bool primaryNewState() const {
@@ -4783,7 +5736,10 @@ public:
             return innerInsertion.second;
         }
         virtual double previousTimestamp() const {
-            return innerInsertion.first->second;
+            return innerInsertion.first->second.first;
+        }
+        virtual int previousSteps() const {
+            return innerInsertion.first->second.second;
         }
 
     };
@@ -4813,7 +5769,10 @@ public:
             return (innerFind == innerEnd);
         }
         virtual double previousTimestamp() const {
-            return innerFind->second;
+            return innerFind->second.first;
+        }
+        virtual int previousSteps() const {
+            return innerFind->second.second;
         }
     };
 
@@ -4869,14 +5828,14 @@ public:
         return numberOfVarsWithDominanceConstraints;
     }
 
-    DominanceStateHash() {
+    DominanceStateHash() : storedStates(0) {
         assert(numberOfVarsWithDominanceConstraints || !RPGBuilder::getPreferences().empty());
     }
 
     ~DominanceStateHash() {
     }
 
-    virtual InsertIterator * insertState(SearchQueueItem * const s, StatesToDelete * const keptStates)  __attribute__((warn_unused_result)) {
+    virtual InsertIterator * insertState(SearchQueueItem * const s, StatesToDelete * const keptStates, StateHash::FindIterator * const)  __attribute__((warn_unused_result)) {
 
         InsertIterator* const toReturn = insertState(s->state());
 
@@ -4894,6 +5853,7 @@ public:
     virtual InsertIterator * insertState(ExtendedMinimalState * const e)  __attribute__((warn_unused_result)) {
         static const bool insDebug = false;
         static ParetoStatesAndOthers emptyInner;
+        SearchProfile::Timer profileTimer(SearchProfile::E_STATE_HASH_INSERT);
         InsertIterator* const toReturn = new InsertIterator();
 
         toReturn->outerInsertion = insert(make_pair(e, emptyInner));
@@ -4908,7 +5868,7 @@ public:
             // so, it's got to be new.
             toReturn->outerInsertion.first->second.paretoStates.push_front(make_pair(e, e->timeStamp));
             toReturn->paretoStateListIterator = toReturn->outerInsertion.first->second.paretoStates.begin();
-            toReturn->innerInsertion = toReturn->outerInsertion.first->second.others.insert(make_pair(e, e->timeStamp));
+            toReturn->innerInsertion = toReturn->outerInsertion.first->second.others.insert(make_pair(e, make_pair(e->timeStamp, stepsToReach(*e))));
         } else {
             // work out if this dominates any existing states on the list
 
@@ -5041,7 +6001,7 @@ public:
                     cout << "As it's identical to something, or dominated by something, just doing a secondary insertion of " << e << "\n";
                 }
 
-                toReturn->innerInsertion = toReturn->outerInsertion.first->second.others.insert(make_pair(e, e->timeStamp));
+                toReturn->innerInsertion = toReturn->outerInsertion.first->second.others.insert(make_pair(e, make_pair(e->timeStamp, stepsToReach(*e))));
 
                 if ((Globals::globalVerbosity & 1) && toReturn->innerInsertion.second) {
                     cout << "D"; cout.flush();
@@ -5052,7 +6012,7 @@ public:
                         cout << "As it dominates something, or is non-dominated, doing a primary insertion of " << e << " and adding to the pareto list\n";
                     }
 
-                    toReturn->innerInsertion = toReturn->outerInsertion.first->second.others.insert(make_pair(e, e->timeStamp));
+                    toReturn->innerInsertion = toReturn->outerInsertion.first->second.others.insert(make_pair(e, make_pair(e->timeStamp, stepsToReach(*e))));
 
                     if (toReturn->innerInsertion.second) {
                         toReturn->outerInsertion.first->second.paretoStates.push_front(make_pair(e, e->timeStamp));
@@ -5071,7 +6031,7 @@ public:
                         cout << "Secondary insertion of " << e << ": the residual case\n";
                     }
 
-                    toReturn->innerInsertion = toReturn->outerInsertion.first->second.others.insert(make_pair(e, e->timeStamp));
+                    toReturn->innerInsertion = toReturn->outerInsertion.first->second.others.insert(make_pair(e, make_pair(e->timeStamp, stepsToReach(*e))));
                     if ((Globals::globalVerbosity & 1) && toReturn->innerInsertion.second) {
                         cout << "D"; cout.flush();
                     }
@@ -5080,11 +6040,16 @@ public:
 
         }
 
+        if (toReturn->innerInsertion.second) {
+            SearchProfile::noteClosedListSize(++storedStates);
+        }
+
         return toReturn;
     }
 
 
     virtual FindIterator* findState(ExtendedMinimalState * const e) const   __attribute__((warn_unused_result)) {
+        SearchProfile::Timer profileTimer(SearchProfile::E_STATE_HASH_LOOKUP);
         FindIterator * const toReturn = new FindIterator(this->DominanceMap::find(e), this->DominanceMap::end());
         if (toReturn->outerFind != end()) {
             toReturn->innerFind = toReturn->outerFind->second.others.find(e);
@@ -5170,6 +6135,7 @@ public:
 
     virtual void clear() {
         this->DominanceMap::clear();
+        storedStates = 0;
     }
 
 };
@@ -5772,7 +6738,6 @@ list<FFEvent> * FF::doBenchmark(bool & reachedGoal, list<FFEvent> * oldSoln, con
             stepID = currSQI->state()->getInnerState().planLength;
         }
 
-        FFcache_upToDate = false;
 
         int currStepID = currSQI->state()->getInnerState().planLength;
 
@@ -5859,7 +6824,7 @@ list<FFEvent> * FF::doBenchmark(bool & reachedGoal, list<FFEvent> * oldSoln, con
             //assert(tryToSchedule.isSolved());
 
             vector<double> timeAtWhichValueIsDefined;
-            tryToSchedule.removeExpiredAbstractFacts(succ->state()->getEditableInnerState().first);
+            tryToSchedule.removeExpiredAbstractFacts(succ->state()->getEditableInnerState());
             tryToSchedule.updateStateFluents(succ->state()->getEditableInnerState().secondMin, succ->state()->getEditableInnerState().secondMax, timeAtWhichValueIsDefined);
         } else {
 
@@ -6148,8 +7113,52 @@ void printASList(const list<ActionSegment> & helpfulActions) {
 
 }
 
+/** @brief Say why search is stopping early, having been told it must. */
+static void reportSearchStopped()
+{
+    if (Globals::searchWasCancelled()) {
+        std::cerr << "\n\nSearch cancelled: terminating\n";
+    } else {
+        std::cerr << "\n\nTime limit reached: terminating\n";
+    }
+}
+
+/** @brief Whether a state just reached is in the closed list already, with a timestamp no later than its own.
+ *
+ *  If so, inserting it into the closed list once its temporal soundness has been checked could only find it to be a
+ *  duplicate: checking it only ever moves its timestamp later.  So it can be pruned before that check, using the same
+ *  test the insertion would.  If <code>zealous</code>, as in EHC, matching on the weak projection alone is enough.
+ *  A state reached in fewer steps than before is never pruned, as the insertion would reopen it: see
+ *  <code>reachedInFewerSteps()</code>.  The lookup is left in <code>lookup</code>, to pass on to the insertion.
+ */
+static bool memoisedNoLater(const StateHash & visitedStates, ExtendedMinimalState * const e, const bool & zealous,
+                            unique_ptr<StateHash::FindIterator> & lookup)
+{
+    lookup.reset(visitedStates.findState(e));
+    if (lookup->primaryNewState()) return false;
+    if (zealous) return true;
+    if (lookup->secondaryNewState()) return false;
+    if (reachedInFewerSteps(*e, lookup->previousSteps())) return false;
+
+    const double & previousTS = lookup->previousTimestamp();
+    return !(fabs(e->timeStamp - previousTS) > 0.0005 && e->timeStamp < previousTS);
+}
+
+/** @brief Declared first in <code>FF::search()</code>, so its pools are emptied on return, unless any state outlives the search. */
+struct ReleasePooledMemoryOnReturn {
+    ~ReleasePooledMemoryOnReturn() {
+        SearchQueueItem::releasePooledMemory();
+        ExtendedMinimalState::releasePooledMemory();
+        MinimalState::releasePooledMemory();
+    }
+};
+
 Solution FF::search(bool & reachedGoal)
 {
+    ReleasePooledMemoryOnReturn releasePooledMemory;
+    const SearchProfile::Session profileSession;
+
+    context().heuristicCache->clear();
 
     static bool initCSBase = false;
 
@@ -6238,7 +7247,7 @@ Solution FF::search(bool & reachedGoal)
                 if (!currStatic.second) {
                     cout << "Static goal " << *(*gsItr) << " resolves to false: no plan can solve this problem\n";
                     reachedGoal = false;
-                    return workingBestSolution;
+                    return context().workingBestSolution;
                 }
             } else {
                 goals.insert((*gsItr)->getStateID());
@@ -6290,7 +7299,7 @@ Solution FF::search(bool & reachedGoal)
             if (admissibleCostExceedsBound(initialSQI->heuristicValue.admissibleCostEstimate,false)) {
                 cout << "; No plan can possibly improve on no plan at all, goals not met\n";
                 reachedGoal = false;
-                return workingBestSolution;
+                return context().workingBestSolution;
             }
         }
 
@@ -6310,7 +7319,7 @@ Solution FF::search(bool & reachedGoal)
         if (bestHeuristic.heuristicValue == -1.0) {
             cout << "; Goals unreachable from the initial state\n";
             reachedGoal = false;
-            return workingBestSolution;
+            return context().workingBestSolution;
         }
 
 
@@ -6337,11 +7346,11 @@ Solution FF::search(bool & reachedGoal)
             const pair<bool,bool> prognosis(carryOnSearching(initialSQI->state()->getInnerState(), initialSQI->plan, bestCurrentCost, bestHeuristic.admissibleCostEstimate, ignore));
             if (!prognosis.first ) {
                 cout << "; The empty plan is optimal\n";
-                return workingBestSolution;
+                return context().workingBestSolution;
             }
             if (!prognosis.second) {
                 cout << "; No plan can possibly improve on no plan at all\n";
-                return workingBestSolution;
+                return context().workingBestSolution;
             }
 
 
@@ -6392,19 +7401,9 @@ Solution FF::search(bool & reachedGoal)
 
     while (!searchQueue.empty()) {
 
-        if (Globals::timeLimit != INT_MAX) {
-
-            tms refReturn;
-            times(&refReturn);
-            double secs = ((double)refReturn.tms_utime + (double)refReturn.tms_stime) / ((double) sysconf(_SC_CLK_TCK));
-
-            if (secs >= Globals::timeLimit) {
-                std::cerr << "HEREEEEEE" << std::endl;
-                cout << "HEREEEEEE" << std::endl;
-                std::cerr << "\n\nTime limit reached: terminating\n";
-                return workingBestSolution;
-                // exit(2);
-            }
+        if (Globals::timeToStop()) {
+            reportSearchStopped();
+            return context().workingBestSolution;
         }
 
         if (Globals::globalVerbosity & 2) cout << "\n--\n";
@@ -6467,6 +7466,8 @@ Solution FF::search(bool & reachedGoal)
 
             unique_ptr<SearchQueueItem> succ;
             bool tsSound = false;
+            bool alreadyMemoised = false;
+            unique_ptr<StateHash::FindIterator> memoisedLookup;
             const int oldTIL = currSQI->state()->getInnerState().nextTIL;
 
             list<pair<int, FFEvent> > newDummySteps;
@@ -6490,7 +7491,7 @@ Solution FF::search(bool & reachedGoal)
                     if (Globals::optimiseSolutionQuality) {
                         succ->heuristicValue.admissibleCostEstimate = calculateAdmissibleCost(succ->state()->getInnerState(),succ->heuristicValue.makespan,currSQI->heuristicValue.admissibleCostEstimate,false);
                         if (admissibleCostExceedsBound(succ->heuristicValue.admissibleCostEstimate, false)) {
-                            ++statesDiscardedAsTooExpensiveBeforeHeuristic;
+                            ++context().statesDiscardedAsTooExpensiveBeforeHeuristic;
                             tsSound = false;
                         }
                     }
@@ -6501,7 +7502,10 @@ Solution FF::search(bool & reachedGoal)
             } else {
                 //registerFinished(*(succ->state), helpfulActsItr->needToFinish);
                 succ = unique_ptr<SearchQueueItem>(new SearchQueueItem(applyActionToState(*helpfulActsItr, *(currSQI->state()), currSQI->plan, newDummySteps), true));
-                if (succ->state()) {
+                if (succ->state() && pruneMemoised && memoisedNoLater(*visitedStates, succ->state(), zealousEHC, memoisedLookup)) {
+                    alreadyMemoised = true;
+                    tsSound = false;
+                } else if (succ->state()) {
                     tsSound =    stateHasProgressedBeyondItsParent(*helpfulActsItr, *(currSQI->state()), *(succ->state()))  // it had some beneficial effects
                               && checkTemporalSoundness(currSQI->state(), *(succ->state()), *helpfulActsItr, oldTIL);                         // it didn't introduce a trivial cycle
                 } else {
@@ -6514,7 +7518,7 @@ Solution FF::search(bool & reachedGoal)
                     if (Globals::optimiseSolutionQuality) {
                         succ->heuristicValue.admissibleCostEstimate = calculateAdmissibleCost(succ->state()->getInnerState(),succ->heuristicValue.makespan,currSQI->heuristicValue.admissibleCostEstimate,false);
                         if (admissibleCostExceedsBound(succ->heuristicValue.admissibleCostEstimate, false)) {
-                            ++statesDiscardedAsTooExpensiveBeforeHeuristic;
+                            ++context().statesDiscardedAsTooExpensiveBeforeHeuristic;
                             tsSound = false;
                         }
                     }
@@ -6524,7 +7528,7 @@ Solution FF::search(bool & reachedGoal)
 
 
             if (!tsSound) {
-	      if (Globals::globalVerbosity & 1) {cout << "t"; cout.flush();}
+	      if (Globals::globalVerbosity & 1) {cout << (alreadyMemoised ? "s" : "t"); cout.flush();}
             } else {
 
 
@@ -6565,7 +7569,6 @@ Solution FF::search(bool & reachedGoal)
                             //registerFinished(toSolve->rpg, succ->state, needToFinish);
 
                             ActionSegment tempSeg(0, Planner::E_AT, tn - 1, RPGHeuristic::emptyIntList);
-                            FFcache_upToDate = false;
 
                             pair<bool,double> currentCost(false, std::numeric_limits< double >::signaling_NaN());
 
@@ -6618,7 +7621,7 @@ Solution FF::search(bool & reachedGoal)
                 if (!TILfailure) {
 
                     ExtendedMinimalState * const hunting = succ->state();
-                    insResult = unique_ptr<StateHash::InsertIterator>(visitedStates->insertState(succ.get(), statesKept.get()));
+                    insResult = unique_ptr<StateHash::InsertIterator>(visitedStates->insertState(succ.get(), statesKept.get(), memoisedLookup.get()));
                     visitTheState = insResult->primaryNewState();
 
                     if (!zealousEHC && !visitTheState) {
@@ -6631,11 +7634,6 @@ Solution FF::search(bool & reachedGoal)
                         }
 
                     }
-#ifdef STATEHASHDEBUG
-                    if (visitTheState) {
-                        succ->mustNotDeleteState = true;
-                    }
-#endif
 
 #ifdef DOUBLESTATEHASH
                     if (zealousEHC) {
@@ -6698,7 +7696,7 @@ Solution FF::search(bool & reachedGoal)
                             bool forceRestart = false;
                             const pair<bool,bool> prognosis(carryOnSearching(succ->state()->getInnerState(), succ->plan, currentCost, succ->heuristicValue.admissibleCostEstimate, forceRestart));
                             if (!prognosis.first) {
-                                return workingBestSolution;
+                                return context().workingBestSolution;
                             }
                             foundBetter = true;
                             if (prognosis.second && !forceRestart) {
@@ -6735,6 +7733,7 @@ Solution FF::search(bool & reachedGoal)
                             }
                         } else {
 			  if (Globals::globalVerbosity & 1) {cout << "."; cout.flush();}
+                            succ->packPlan(helpfulActsItr->second == Planner::E_AT ? TILparent : currSQI.get());
                             searchQueue.push_back(succ.release(), 1);
                         }
                     } else {
@@ -6762,7 +7761,7 @@ Solution FF::search(bool & reachedGoal)
         cout << "\nProblem unsolvable by EHC, and best-first search has been disabled\n";
 
         reachedGoal = false;
-        return workingBestSolution;
+        return context().workingBestSolution;
     }
 
     visitedStates->clear();
@@ -6802,7 +7801,12 @@ Solution FF::search(bool & reachedGoal)
         }
 
 
-        if (restartWithGoalStates) {
+        // once a plan has been found, carry on from the open and closed lists of the search that found it
+        const bool continuingSearch = (FF::reuseSearchAcrossWeights && aStarWeightItr != weightSeries.begin());
+
+        if (continuingSearch) {
+            cout << "Continuing WA* with W = " << doubleU << ", reusing the states already evaluated\n";
+        } else if (restartWithGoalStates) {
             cout << "Running WA* with W = " << doubleU << ", restarting with goal states\n";
         } else {
             cout << "Running WA* with W = " << doubleU << ", not restarting with goal states\n";
@@ -6813,46 +7817,50 @@ Solution FF::search(bool & reachedGoal)
         oldZealousVisitedStates.clear();
     #endif
 
-        searchQueue.clear();
-        statesKept = unique_ptr<StatesToDelete>(new StatesToDelete(&initialState));
-
-
+        if (continuingSearch) {
+            searchQueue.rekey();
+        } else {
+            searchQueue.clear();
+            statesKept = unique_ptr<StatesToDelete>(new StatesToDelete(&initialState));
 
-        {
 
-            if (FF::biasD) {
-                initialHeuristic.qbreak = 1;
-            } else if (FF::biasG) {
-                initialHeuristic.qbreak = initialHeuristic.heuristicValue;
-            } else {
-                initialHeuristic.qbreak = 0;
-            }
 
+            {
 
-            SearchQueueItem * const initialSQI = new SearchQueueItem(&initialState, false);
+                if (FF::biasD) {
+                    initialHeuristic.qbreak = 1;
+                } else if (FF::biasG) {
+                    initialHeuristic.qbreak = initialHeuristic.heuristicValue;
+                } else {
+                    initialHeuristic.qbreak = 0;
+                }
 
-            //cout << "About to insert SQI " << initialSQI << " into search queue\n";
 
-            initialSQI->plan = stepsForInitialAbstractTILs;
-            initialSQI->heuristicValue = initialHeuristic;
-            bestHeuristic = initialHeuristic;
-            searchQueue.insert(initialSQI, 1);
-            //visitedStates.find(initialSQI->state)->second.second = true;
+                SearchQueueItem * const initialSQI = new SearchQueueItem(&initialState, false);
 
-            {
-                ExtendedMinimalState * const toHash = initialState.clone();
-                toHash->timeStamp = 0.0;
-                unique_ptr<StateHash::InsertIterator> itr(visitedStates->insertState(toHash));
-                itr->setTimestampOfThisState(toHash);
-                statesKept->alsoCleanUp(toHash);
+                //cout << "About to insert SQI " << initialSQI << " into search queue\n";
 
-    #ifdef DOUBLESTATEHASH
-                list<pair<pair<HTrio, bool>, double> > tList;
-                tList.push_back(pair<pair<HTrio, bool>, double>(pair<HTrio, bool>(bestHeuristic, true), 0.0));
+                initialSQI->plan = stepsForInitialAbstractTILs;
+                initialSQI->heuristicValue = initialHeuristic;
+                bestHeuristic = initialHeuristic;
+                searchQueue.insert(initialSQI, 1);
+                //visitedStates.find(initialSQI->state)->second.second = true;
 
-                oldVisitedStates.insert(pair<ExtendedMinimalState, list<pair<pair<HTrio, bool>, double> > >(*toHash, tList));
-                oldZealousVisitedStates.insert(pair<ExtendedMinimalState, list<pair<pair<HTrio, bool>, double> > >(*toHash, tList));
-    #endif
+                {
+                    ExtendedMinimalState * const toHash = initialState.clone();
+                    toHash->timeStamp = 0.0;
+                    unique_ptr<StateHash::InsertIterator> itr(visitedStates->insertState(toHash));
+                    itr->setTimestampOfThisState(toHash);
+                    statesKept->alsoCleanUp(toHash);
+
+        #ifdef DOUBLESTATEHASH
+                    list<pair<pair<HTrio, bool>, double> > tList;
+                    tList.push_back(pair<pair<HTrio, bool>, double>(pair<HTrio, bool>(bestHeuristic, true), 0.0));
+
+                    oldVisitedStates.insert(pair<ExtendedMinimalState, list<pair<pair<HTrio, bool>, double> > >(*toHash, tList));
+                    oldZealousVisitedStates.insert(pair<ExtendedMinimalState, list<pair<pair<HTrio, bool>, double> > >(*toHash, tList));
+        #endif
+                }
             }
         }
 
@@ -6860,32 +7868,77 @@ Solution FF::search(bool & reachedGoal)
 
         while (!triggerRestart && !searchQueue.empty()) {
 
-            if (Globals::timeLimit != INT_MAX) {
+            if (Globals::timeToStop()) {
+                reportSearchStopped();
+                return context().workingBestSolution;
+            }
+
 
-                tms refReturn;
-                times(&refReturn);
-                double secs = ((double)refReturn.tms_utime + (double)refReturn.tms_stime) / ((double) sysconf(_SC_CLK_TCK));
+            unique_ptr<SearchQueueItem> poppedSQI(searchQueue.pop_front());
 
-                if (secs >= Globals::timeLimit) {
-                    std::cerr << "\n\nTime limit reached: terminating\n";
-                    std::cerr << "HEREEEEEE" << std::endl;
-                    cout << "HEREEEEEE" << std::endl;
-                    std::cerr << "\n\nTime limit reached: terminating\n";
-                    return workingBestSolution;
+            //cout << "SQI at " << poppedSQI.get() << ", EMS at " << poppedSQI->state() << endl;
 
-                    exit(2);
-                }
+            if (poppedSQI->state()->hasBeenDominated) {
+                continue;
             }
 
+            if (poppedSQI->deferred) {
+                // queued with its parent's heuristic value: evaluate it now it has come to be expanded
+                const unique_ptr<DeferredEvaluation> pending(poppedSQI->deferred.release());
+                SearchQueueItem * const parent = pending->parent.get();
+
+                FFheader_upToDate = false;
+                FFonly_one_successor = false;
 
-            unique_ptr<SearchQueueItem> currSQI(searchQueue.pop_front());
+                pair<bool,double> currentCost(false, std::numeric_limits< double >::signaling_NaN());
 
-            //cout << "SQI at " << currSQI.get() << ", EMS at " << currSQI->state() << endl;
+                parent->unpackPlan();
 
-            if (currSQI->state()->hasBeenDominated) {
-                continue;
+                evaluateStateAndUpdatePlan(poppedSQI, *(poppedSQI->state()), parent->state(), goals, numericGoals, 0,
+                                           poppedSQI->helpfulActions, currentCost, pending->action, parent->plan, pending->newDummySteps);
+
+                parent->packForDeferredSuccessors();
+
+                if (poppedSQI->heuristicValue.heuristicValue == -1.0) {
+                    if (Globals::globalVerbosity & 1) {
+                        cout << "d"; cout.flush();
+                    }
+                    continue;
+                }
+
+                bool keepState = true;
+
+                if (poppedSQI->heuristicValue.goalsSatisfied) {
+                    reachedGoal = true;
+                    bool forceRestart = false;
+                    const pair<bool,bool> prognosis(carryOnSearching(poppedSQI->state()->getInnerState(), poppedSQI->plan, currentCost, poppedSQI->heuristicValue.admissibleCostEstimate, forceRestart));
+                    if (!prognosis.first) {
+                        return context().workingBestSolution;
+                    }
+                    keepState = prognosis.second;
+                    if (forceRestart && restartWithGoalStates) {
+                        triggerRestart = true;
+                    }
+                }
+
+                pending->closedListEntry->setTimestampOfThisState(poppedSQI->state());
+
+                if (poppedSQI->heuristicValue.heuristicValue < bestHeuristic.heuristicValue || (FF::makespanTieBreak && (poppedSQI->heuristicValue.heuristicValue == bestHeuristic.heuristicValue && poppedSQI->heuristicValue.makespan < bestHeuristic.makespan))) {
+                    bestHeuristic = poppedSQI->heuristicValue;
+                    searchQueue.boostPreferred();
+                    if (!(Globals::globalVerbosity & 2)) {
+                        cout << "b (" << bestHeuristic.heuristicValue << " | " << bestHeuristic.makespan << ")" ; cout.flush();
+                    }
+                }
+
+                if (!keepState || (triggerRestart && !FF::reuseSearchAcrossWeights)) {
+                    continue;
+                }
             }
 
+            // shared, so states reached from it can be evaluated after it has been expanded
+            const std::shared_ptr<SearchQueueItem> currSQI(poppedSQI.release());
+
             if (Globals::globalVerbosity & 2) {
                 cout << "\n--\n";
                 cout << "Now visiting state with heuristic value of " << currSQI->heuristicValue.heuristicValue << " | " << currSQI->heuristicValue.makespan << "\n";
@@ -6955,10 +8008,13 @@ Solution FF::search(bool & reachedGoal)
             const unique_ptr<ParentData> incrementalData(FF::allowCompressionSafeScheduler ? nullptr : LPScheduler::prime(currSQI->plan, currSQI->state()->getInnerState().temporalConstraints,
                     currSQI->state()->startEventQueue, Globals::optimiseSolutionQuality));
 
-            for (; !triggerRestart && helpfulActsItr != helpfulActsEnd; ++helpfulActsItr) {
+            // if the search is to be carried on with a lower weight, finish expanding the state, as it will not be visited again
+            for (; (!triggerRestart || FF::reuseSearchAcrossWeights) && helpfulActsItr != helpfulActsEnd; ++helpfulActsItr) {
                 unique_ptr<SearchQueueItem> succ;
 
                 bool tsSound = false;
+                bool alreadyMemoised = false;
+                unique_ptr<StateHash::FindIterator> memoisedLookup;
                 const int oldTIL = currSQI->state()->getInnerState().nextTIL;
 
                 list<ActionSegment> nowList;
@@ -6982,7 +8038,7 @@ Solution FF::search(bool & reachedGoal)
                         if (Globals::optimiseSolutionQuality) {
                             succ->heuristicValue.admissibleCostEstimate = calculateAdmissibleCost(succ->state()->getInnerState(),succ->heuristicValue.makespan,currSQI->heuristicValue.admissibleCostEstimate,false);
                             if (admissibleCostExceedsBound(succ->heuristicValue.admissibleCostEstimate, false)) {
-                                ++statesDiscardedAsTooExpensiveBeforeHeuristic;
+                                ++context().statesDiscardedAsTooExpensiveBeforeHeuristic;
                                 tsSound = false;
                             }
                         }
@@ -6995,6 +8051,9 @@ Solution FF::search(bool & reachedGoal)
 
                     if (!succ->state()) {
                         tsSound = false;
+                    } else if (pruneMemoised && memoisedNoLater(*visitedStates, succ->state(), false, memoisedLookup)) {
+                        alreadyMemoised = true;
+                        tsSound = false;
                     } else {
                         tsSound = (   stateHasProgressedBeyondItsParent(*helpfulActsItr, *(currSQI->state()), *(succ->state()))
                                 && checkTemporalSoundness(currSQI->state(), *(succ->state()), *helpfulActsItr)                                  );
@@ -7006,7 +8065,7 @@ Solution FF::search(bool & reachedGoal)
                         if (Globals::optimiseSolutionQuality) {
                             succ->heuristicValue.admissibleCostEstimate = calculateAdmissibleCost(succ->state()->getInnerState(),succ->heuristicValue.makespan,currSQI->heuristicValue.admissibleCostEstimate,false);
                             if (admissibleCostExceedsBound(succ->heuristicValue.admissibleCostEstimate, false)) {
-                                ++statesDiscardedAsTooExpensiveBeforeHeuristic;
+                                ++context().statesDiscardedAsTooExpensiveBeforeHeuristic;
                                 tsSound = false;
                             }
                         }
@@ -7025,9 +8084,13 @@ Solution FF::search(bool & reachedGoal)
 
                 if (!tsSound) {
                     if (Globals::globalVerbosity & 2) {
-                        cout << "\tTemporally invalid choice\n";
+                        if (alreadyMemoised) {
+                            cout << "\tState already memoised, with a timestamp no later\n";
+                        } else {
+                            cout << "\tTemporally invalid choice\n";
+                        }
                     } else if (Globals::globalVerbosity & 1) {
-                        cout << "t"; cout.flush();
+                        cout << (alreadyMemoised ? "s" : "t"); cout.flush();
                     }
                 } else {
                     assert(succ->state());
@@ -7061,6 +8124,8 @@ Solution FF::search(bool & reachedGoal)
                                 const double & previousTS = lookup->previousTimestamp();
                                 if (fabs(previousTS - succ->state()->timeStamp) > 0.0005 && (previousTS > succ->state()->timeStamp)) {
                                     visitTheState = 2;
+                                } else if (reachedInFewerSteps(*(succ->state()), lookup->previousSteps())) {
+                                    visitTheState = 2;
                                 }
                             }
                         }
@@ -7072,7 +8137,6 @@ Solution FF::search(bool & reachedGoal)
 
                             for (int tn = oldTIL + 1; tn <= helpfulActsItr->divisionID; ++tn) {
                                 ActionSegment tempSeg(0, Planner::E_AT, tn - 1, RPGHeuristic::emptyIntList);
-                                FFcache_upToDate = false;
 
                                 pair<bool,double> currentCost(false, std::numeric_limits< double >::signaling_NaN());
 
@@ -7106,7 +8170,6 @@ Solution FF::search(bool & reachedGoal)
                                 }
                                 incrementalIsDead = true;
                             }
-                            FFcache_upToDate = false;
                         }
                     }
 
@@ -7121,7 +8184,7 @@ Solution FF::search(bool & reachedGoal)
 
                     if (!TILfailure) {
 
-                        insResult = unique_ptr<StateHash::InsertIterator>(visitedStates->insertState(succ.get(), statesKept.get()));
+                        insResult = unique_ptr<StateHash::InsertIterator>(visitedStates->insertState(succ.get(), statesKept.get(), memoisedLookup.get()));
 
                         if (insResult->primaryNewState()) {
                             visitTheState = 1;
@@ -7132,16 +8195,12 @@ Solution FF::search(bool & reachedGoal)
                                 const double & previousTS = insResult->previousTimestamp();
                                 if (fabs(previousTS - succ->state()->timeStamp) > 0.0005 && (previousTS > succ->state()->timeStamp)) {
                                     visitTheState = 2;
+                                } else if (reachedInFewerSteps(*(succ->state()), insResult->previousSteps())) {
+                                    visitTheState = 2;
                                 }
                             }
                         }
 
-    #ifdef STATEHASHDEBUG
-                        if (insResult->outerInsertion.second || insResult->innerInsertion.second) {
-                            succ->mustNotDeleteState = true;
-                        }
-    #endif
-
     #ifdef DOUBLESTATEHASH
 
                         int doubleVisitTheState = 0;
@@ -7172,7 +8231,23 @@ Solution FF::search(bool & reachedGoal)
                         }
                     }
 
-                    if (visitTheState) {
+                    if (visitTheState && FF::deferredEvaluation && helpfulActsItr->second != Planner::E_AT) {
+
+                        // its own heuristic value is computed when it is popped: until then, queue it as well as its parent
+                        const double admissibleCostEstimate = succ->heuristicValue.admissibleCostEstimate;
+                        succ->heuristicValue = currSQI->heuristicValue;
+                        succ->heuristicValue.admissibleCostEstimate = admissibleCostEstimate;
+                        succ->heuristicValue.goalsSatisfied = false;
+
+                        succ->preferred = isHelpfulAction(*helpfulActsItr, currSQI->helpfulActions);
+                        succ->deferred.reset(new DeferredEvaluation(currSQI, *helpfulActsItr, newDummySteps, insResult.release()));
+
+                        if (Globals::globalVerbosity & 1 && !(Globals::globalVerbosity & 2)) {
+                            cout << (succ->preferred ? "+" : ","); cout.flush();
+                        }
+                        searchQueue.insert(succ.release(), visitTheState);
+
+                    } else if (visitTheState) {
 
                         pair<bool,double> currentCost(false, std::numeric_limits< double >::signaling_NaN());
 
@@ -7197,7 +8272,7 @@ Solution FF::search(bool & reachedGoal)
                                 bool forceRestart = false;
                                 const pair<bool,bool> prognosis(carryOnSearching(succ->state()->getInnerState(), succ->plan, currentCost, succ->heuristicValue.admissibleCostEstimate, forceRestart));
                                 if (!prognosis.first) {
-                                    return workingBestSolution;
+                                    return context().workingBestSolution;
                                 }
                                 keepState = prognosis.second;
                                 if (forceRestart && restartWithGoalStates) {
@@ -7213,9 +8288,16 @@ Solution FF::search(bool & reachedGoal)
     #endif
                             if (keepState) {
 
+                                succ->packPlan(helpfulActsItr->second == Planner::E_AT ? TILparent : currSQI.get());
+
+                                if (FF::preferredQueue) {
+                                    succ->preferred = isHelpfulAction(*helpfulActsItr, currSQI->helpfulActions);
+                                }
+
                                 if (succ->heuristicValue.heuristicValue < bestHeuristic.heuristicValue || (FF::makespanTieBreak && (succ->heuristicValue.heuristicValue == bestHeuristic.heuristicValue && succ->heuristicValue.makespan < bestHeuristic.makespan))) {
 
                                     bestHeuristic = succ->heuristicValue;
+                                    searchQueue.boostPreferred();
                                     if (Globals::globalVerbosity & 2) {
                                         cout << "\t" << bestHeuristic.heuristicValue << " | " << bestHeuristic.makespan << ", category " << visitTheState << " - a new best heuristic value, with plan:\n";
                                         //succ->printPlan();
@@ -7253,9 +8335,21 @@ Solution FF::search(bool & reachedGoal)
                 }
             }
 
+            if (currSQI.use_count() > 1) {
+                // successors are queued to be evaluated from it later: until then, keep it packed
+                currSQI->packForDeferredSuccessors();
+            }
+
         }
 
-        visitedStates->clear();
+        if (FF::reuseSearchAcrossWeights) {
+            if (!triggerRestart) {
+                // the open list was exhausted, so lower weights would have nothing left to expand
+                break;
+            }
+        } else {
+            visitedStates->clear();
+        }
     }
 
 
@@ -7263,12 +8357,32 @@ Solution FF::search(bool & reachedGoal)
     cout << "\nProblem Unsolvable\n";
 
     reachedGoal = false;
-    return workingBestSolution;
+    return context().workingBestSolution;
 
 };
 
-list<FFEvent> * FF::reprocessPlan(list<FFEvent> * oldSoln, TemporalConstraints * cons)
+/** @brief Say why rescheduling the plan found is being given up, and the plan returned as found. */
+static void reportRescheduleAbandoned()
+{
+    if (Globals::searchWasCancelled()) {
+        std::cerr << "\nRescheduling cancelled: returning the plan as found\n";
+    } else {
+        std::cerr << "\nTime limit reached while rescheduling: returning the plan as found\n";
+    }
+}
+
+list<FFEvent> * FF::reprocessPlan(list<FFEvent> * oldSoln, TemporalConstraints * cons, double * const quality)
 {
+    // search is over, so rescheduling can have the rest of the time limit
+    Globals::startPostSearchWork();
+
+    if (Globals::timeToStop()) {
+        // cancelled, or out of time already: return the plan as found
+        return oldSoln;
+    }
+
+    context().heuristicCache->clear();
+
     static bool initCSBase = false;
 
     if (!initCSBase) {
@@ -7547,6 +8661,12 @@ list<FFEvent> * FF::reprocessPlan(list<FFEvent> * oldSoln, TemporalConstraints *
         }
     }
 
+    if (Globals::timeToStop()) {
+        delete currSQI;
+        reportRescheduleAbandoned();
+        return oldSoln;
+    }
+
 
     unique_ptr<StatesToDelete> statesKept(new StatesToDelete(&initialState));
 
@@ -7554,6 +8674,8 @@ list<FFEvent> * FF::reprocessPlan(list<FFEvent> * oldSoln, TemporalConstraints *
 
     const int lastStep = sortedSoln.size() - 1;
 
+    pair<bool,double> lastCost(false, std::numeric_limits< double >::signaling_NaN());
+
     for (int stepID = 0; oldSolnItr != oldSolnEnd; ++oldSolnItr, ++stepID) {
 
         #ifdef ENABLE_DEBUGGING_HOOKS
@@ -7583,12 +8705,30 @@ list<FFEvent> * FF::reprocessPlan(list<FFEvent> * oldSoln, TemporalConstraints *
 
         evaluateStateAndUpdatePlan(succ,  *(succ->state()), currSQI->state(), goals, numericGoals, incrementalData.get(), succ->helpfulActions, currentCost, nextSeg, currSQI->plan, newDummySteps);
 
+        lastCost = currentCost;
+
         delete currSQI;
         currSQI = succ.release();
 
+        if (Globals::timeToStop()) {
+            // the LP or RPG may have stopped part-way through, so the plan so far cannot be trusted
+            delete currSQI;
+            reportRescheduleAbandoned();
+            return oldSoln;
+        }
+
     }
     list<FFEvent> * const toReturn = new list<FFEvent>(currSQI->plan);
 
+    if (quality) {
+        // as in carryOnSearching: the LP's cost, if it calculated one, else the metric of the final state
+        if (lastCost.first) {
+            *quality = lastCost.second;
+        } else {
+            *quality = evaluateMetric(currSQI->state()->getInnerState(), currSQI->plan, false);
+        }
+    }
+
     delete currSQI;
     return toReturn;
 }
@@ -36,6 +36,7 @@
 
 #include <map>
 #include <list>
+#include <memory>
 
 using std::map;
 using std::list;
@@ -45,6 +46,7 @@ namespace Planner
 
 class SearchQueueItem;
 class ParentData;
+class HeuristicCache;
 
 
 
@@ -201,6 +203,13 @@ public:
         delete decorated;
     }
 
+    /** @brief Allocated from a pool, as for <code>MinimalState</code>. */
+    static void * operator new(size_t size);
+    static void operator delete(void * p, size_t size);
+
+    /** @brief Return the pool's memory to the heap, if no states are left: called once search is over. */
+    static void releasePooledMemory();
+
     static bool queueEqual(const list<StartEvent> & a, const list<StartEvent> & b) {
         list<StartEvent>::const_iterator aItr = a.begin();
         const list<StartEvent>::const_iterator aEnd = a.end();
@@ -451,13 +460,72 @@ private:
      */
     static pair<bool,bool> carryOnSearching(const MinimalState & theState,  const list<FFEvent> & plan, const pair<bool,double> & currentCost, const double & gCost, bool & wasNewBestSolution);
 
-    static Solution workingBestSolution;
-
     static StateHash* getStateHash();
 public:
 
     static void printPlanAsDot(ostream & o, const list<FFEvent> & plan, const TemporalConstraints * cons);
 
+    /** @brief If set, called with each plan that search accepts as its new best, as soon as it is found. */
+    static void (*newBestSolution)(const Solution & solution);
+
+    /** @brief What FF builds up while solving one problem, as opposed to its options.
+     *
+     *  The best plan found so far, the heuristic cache, the TILs' timestamps and delete effects, and the
+     *  search's counters are kept here rather than in statics, so none of them carries over from one solve
+     *  to the next.  FF uses the context installed by the innermost <code>SearchContext::Use</code> in scope,
+     *  or a default one if there is none.  The problem, and the RPG the heuristic is built on, are still
+     *  global: see <code>RPGBuilder</code>.
+     */
+    class SearchContext
+    {
+
+    public:
+
+        Solution workingBestSolution;
+
+        std::unique_ptr<HeuristicCache> heuristicCache;
+
+        /** @brief Scratch space for packing the inputs of a heuristic evaluation into a key for <code>heuristicCache</code>. */
+        string heuristicCacheKey;
+
+        int statesDiscardedAsTooExpensiveBeforeHeuristic;
+
+        /** @brief Whether the TILs below have been filled in, which is done when first needed. */
+        bool haveTILs;
+        int tilCount;
+        vector<double> tilStamps;
+        vector<list<int> > tilNegativeEffects;
+        /** @brief The delete effects of each TIL that nothing adds back later. */
+        vector<list<int> > tilPermanentNegativeEffects;
+
+        SearchContext();
+        ~SearchContext();
+
+        SearchContext(const SearchContext &) = delete;
+        SearchContext & operator=(const SearchContext &) = delete;
+
+        /** @brief Has FF use a context for as long as this is in scope. */
+        class Use
+        {
+
+        private:
+
+            SearchContext * const previous;
+
+        public:
+
+            Use(SearchContext & c);
+            ~Use();
+
+            Use(const Use &) = delete;
+            Use & operator=(const Use &) = delete;
+        };
+
+    };
+
+    /** @brief The context FF is using: see <code>SearchContext</code>. */
+    static SearchContext & context();
+
     static bool steepestDescent;
     static bool bestFirstSearch;
     static bool helpfulActions;
@@ -473,6 +541,14 @@ public:
     static bool WAStar;
     static double doubleU;
     static double doubleUReduction;
+
+    /** @brief When the weight is reduced after a plan is found, carry on from the open and closed lists, rather than restarting.
+     *
+     *  The open list is re-keyed for the new weight, so the states already evaluated, and their schedules, are reused.
+     *  Rather than ARA*'s list of inconsistent states, a closed state reached again with a lower g (an earlier time,
+     *  or fewer steps) is reopened at once.
+     */
+    static bool reuseSearchAcrossWeights;
     static bool biasG;
     static bool biasD;
     static bool makespanTieBreak;
@@ -483,14 +559,36 @@ public:
     static bool useDominanceConstraintsInStateHash;
     static bool allowCompressionSafeScheduler;
     static double reprocessQualityBound;
-    static int statesDiscardedAsTooExpensiveBeforeHeuristic;
     static bool costOptimalAStar;
     static bool relaxMIP;
+
+    /** @brief In best-first search, queue each successor with its parent's heuristic value, and only evaluate it once it is popped.
+     *
+     *  Successors reached by helpful actions are flagged as preferred, and are expanded ahead of others with the same priority.
+     */
+    static bool deferredEvaluation;
+
+    /** @brief In best-first search, queue the states reached by helpful actions apart from the others, and alternate between the two.
+     *
+     *  On the turn of the queue of other states, the best state in either is expanded, so the search remains complete.
+     */
+    static bool preferredQueue;
+
+    /** @brief How many heuristic evaluations to keep, to reuse if a state is evaluated again with the same inputs: 0 to keep none. */
+    static unsigned int heuristicCacheEntries;
+
+    /** @brief How many extra turns the queue of states reached by helpful actions gets, each time the best heuristic value improves. */
+    static int preferredQueueBoost;
     //static list<instantiatedOp*> * solveSubproblem(LiteralSet & startingState, vector<pair<PNE*, double> > & startingFluents, SubProblem* const s);
     static Solution search(bool & reachedGoal);
 
     static list<FFEvent> * doBenchmark(bool & reachedGoal, list<FFEvent> * soln, const bool doLoops = true);
-    static list<FFEvent> * reprocessPlan(list<FFEvent> * soln, TemporalConstraints * cons);
+
+    /** @brief Reschedule a plan found by search to optimise the metric, as for <code>-Q</code>.
+     *
+     *  @param quality  If non-null, set to the metric of the rescheduled plan (left as it is if search was cancelled)
+     */
+    static list<FFEvent> * reprocessPlan(list<FFEvent> * soln, TemporalConstraints * cons, double * const quality = 0);
 };
 
 
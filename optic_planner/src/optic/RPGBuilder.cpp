@@ -3132,12 +3132,20 @@ void RPGBuilder::initialise()
 {
     RPGdebug = (Globals::globalVerbosity & 16);
     SimpleEvaluator::setInitialState();
-    for (operator_list::const_iterator os = current_analysis->the_domain->ops->begin();
-            os != current_analysis->the_domain->ops->end(); ++os) {
-        if (RPGdebug) cout << (*os)->name->getName() << "\n";
-        instantiatedOp::instantiate(*os, current_analysis->the_problem, *theTC);
-        if (RPGdebug) cout << instantiatedOp::howMany() << " so far\n";
-    };
+
+    const bool groundedFromSnapshot = (!Globals::groundingSnapshot.empty()
+                                       && instantiatedOp::instantiateFromSnapshot(Globals::groundingSnapshot, Globals::taskFingerprint));
+
+    if (groundedFromSnapshot) {
+        if (RPGdebug) cout << "Read " << instantiatedOp::howMany() << " ground actions from " << Globals::groundingSnapshot << "\n";
+    } else {
+        for (operator_list::const_iterator os = current_analysis->the_domain->ops->begin();
+                os != current_analysis->the_domain->ops->end(); ++os) {
+            if (RPGdebug) cout << (*os)->name->getName() << "\n";
+            instantiatedOp::instantiate(*os, current_analysis->the_problem, *theTC);
+            if (RPGdebug) cout << instantiatedOp::howMany() << " so far\n";
+        };
+    }
     if (RPGdebug && Globals::globalVerbosity & 65536) cout << instantiatedOp::howMany() << "\n";
     if (RPGdebug && Globals::globalVerbosity & 65536) instantiatedOp::writeAll(cout);
 
@@ -3162,6 +3170,12 @@ void RPGBuilder::initialise()
             ++fpass;
         } while (instantiatedOp::howMany() < numBefore);
     }
+
+    if (!groundedFromSnapshot && !Globals::groundingSnapshot.empty()) {
+        if (!instantiatedOp::writeSnapshot(Globals::groundingSnapshot, Globals::taskFingerprint)) {
+            cerr << "Warning: could not write the ground actions to " << Globals::groundingSnapshot << endl;
+        }
+    }
     if (RPGdebug && Globals::globalVerbosity & 65536) instantiatedOp::writeAllPNEs(cout);
 
 
@@ -30,6 +30,7 @@
 #include "temporalanalysis.h"
 #include "numericanalysis.h"
 #include "FFSolver.h"
+#include "searchprofile.h"
 
 #include <cmath>
 #include <vector>
@@ -3930,6 +3931,8 @@ public:
 
         numericIsTrueInState.resize(numericAchievedInLayer->size(), false);
 
+        applicableActionsCall = 0;
+
     }
 
 
@@ -4669,6 +4672,27 @@ public:
     list<pair<int, Planner::time_spec> > * const onlyNumericPreconditionActions;
     list<pair<int, Planner::time_spec> > noLongerForbidden;
 
+    /** @brief For <code>findApplicableActions()</code>: how many of each snap-action's propositional preconditions are yet to be seen in the state.
+     *
+     *  An entry only holds for the current call if its stamp matches <code>applicableActionsCall</code>.  Otherwise, it is
+     *  reset from the initial count when first reached, so a call costs only as much as the preconditions it visits, rather
+     *  than a copy of the counts for every action.
+     */
+    vector<int> applicableStartCounts;
+    vector<int> applicableEndCounts;
+    vector<unsigned int> applicableStartStamps;
+    vector<unsigned int> applicableEndStamps;
+    unsigned int applicableActionsCall;
+
+    /** @brief The count for a snap-action in <code>findApplicableActions()</code>, reset from <code>initial</code> if this is the first time it has been reached in this call. */
+    int & applicableCount(vector<int> & counts, vector<unsigned int> & stamps, const vector<int> & initial, const int & act) {
+        if (stamps[act] != applicableActionsCall) {
+            stamps[act] = applicableActionsCall;
+            counts[act] = initial[act];
+        }
+        return counts[act];
+    }
+
 
     static vector<EpsilonResolutionTimestamp> earliestStartAllowed;
     static vector<EpsilonResolutionTimestamp> earliestEndAllowed;
@@ -8801,6 +8825,7 @@ RPGHeuristic::EvaluationInfo* RPGHeuristic::getRelaxedPlan(MinimalState & theSta
                                  list<ActionSegment> & helpfulActions, list<pair<double, list<ActionSegment> > > & relaxedPlan,double & finalPlanMakespanEstimate,
                                  map<double, list<pair<int, int> > > * justApplied, double tilFrom)
 {
+    SearchProfile::Timer profileTimer(SearchProfile::E_RPG_EXPANSION);
 
     const bool evaluateDebug = Globals::globalVerbosity & 64;
     const bool prefDebug = Globals::globalVerbosity & 32768 || PreferenceHandler::preferenceDebug;
@@ -9389,6 +9414,12 @@ RPGHeuristic::EvaluationInfo* RPGHeuristic::getRelaxedPlan(MinimalState & theSta
 
     while (!nextHappening.empty()) {
 
+        if (Globals::timeToStop()) {
+            // treat the state as a dead end: search will notice it has to stop, before it expands another
+            if (evaluateDebug) cout << "Out of time: abandoning RPG expansion\n";
+            return new EvaluationInfo(-1,0.0,false);
+        }
+
         if (evaluateDebug) {
             cout << "Unsatisfied goals: " << payload->unsatisfiedGoals << ", Unappeared ends: " << payload->unappearedEnds << "\n";
             cout << "Expanding RPG forwards, next happening: " << nextHappening.timestamp << "\n";
@@ -10375,7 +10406,10 @@ RPGHeuristic::EvaluationInfo* RPGHeuristic::getRelaxedPlan(MinimalState & theSta
 
     pair<int, Planner::time_spec> earliestTIL(INT_MAX, Planner::E_AT);
 
-    d->extractRP(payload.get(), h, relaxedPlan, earliestTIL, finalPlanMakespanEstimate, earliestRelevanceOfGoal);
+    {
+        SearchProfile::Timer extractionTimer(SearchProfile::E_RELAXED_PLAN_EXTRACTION);
+        d->extractRP(payload.get(), h, relaxedPlan, earliestTIL, finalPlanMakespanEstimate, earliestRelevanceOfGoal);
+    }
 
     if (earliestTIL.first != INT_MAX) {
         for (int tilID = theState.nextTIL; tilID <= earliestTIL.first; ++tilID) {
@@ -12814,8 +12848,20 @@ void RPGHeuristic::Private::findApplicableActions(const MinimalState & theState,
     static const set<int> emptyIntSet;
 
 
-    vector<int> startPreconditionCounts(*initialUnsatisfiedProcessedStartPreconditions);
-    vector<int> endPreconditionCounts(*initialUnsatisfiedEndPreconditions);
+    if (applicableStartStamps.size() != initialUnsatisfiedProcessedStartPreconditions->size()
+        || applicableEndStamps.size() != initialUnsatisfiedEndPreconditions->size()) {
+        applicableStartCounts.resize(initialUnsatisfiedProcessedStartPreconditions->size());
+        applicableEndCounts.resize(initialUnsatisfiedEndPreconditions->size());
+        applicableStartStamps.assign(initialUnsatisfiedProcessedStartPreconditions->size(), 0);
+        applicableEndStamps.assign(initialUnsatisfiedEndPreconditions->size(), 0);
+    }
+
+    if (!(++applicableActionsCall)) {
+        // the stamps have wrapped around, so older ones could be mistaken for this call's
+        applicableStartStamps.assign(applicableStartStamps.size(), 0);
+        applicableEndStamps.assign(applicableEndStamps.size(), 0);
+        applicableActionsCall = 1;
+    }
 
     list<ActionSegment> toFilter;
 
@@ -12890,7 +12936,9 @@ void RPGHeuristic::Private::findApplicableActions(const MinimalState & theState,
             for (; depItr != depEnd; ++depItr) {
                 const int currAct = depItr->first;
                 const Planner::time_spec startOrEnd = depItr->second;
-                int & toManipulate = (startOrEnd == Planner::E_AT_START ? startPreconditionCounts[currAct] : endPreconditionCounts[currAct]);
+                int & toManipulate = (startOrEnd == Planner::E_AT_START
+                                      ? applicableCount(applicableStartCounts, applicableStartStamps, *initialUnsatisfiedProcessedStartPreconditions, currAct)
+                                      : applicableCount(applicableEndCounts, applicableEndStamps, *initialUnsatisfiedEndPreconditions, currAct));
 
                 if (!(--toManipulate)) {
 
@@ -27,7 +27,9 @@
 
 #include "globals.h"
 
+#include <atomic>
 #include <cfloat>
+#include <chrono>
 #include <climits>
 
 #include "RPGBuilder.h"
@@ -247,7 +249,74 @@ double Globals::improvementBetweenSolutions = 0.0;
 bool Globals::givenSolutionQualityDefined = false;
 #endif
 
-int Globals::timeLimit = INT_MAX;
 double Globals::numericTolerance = 0.001;
 
+/** @brief The share of the time limit given to search, leaving the rest for post-search work on the plan found. */
+static const double searchShareOfTimeLimit = 0.8;
+
+/** @brief When search has to stop, in seconds on the steady clock, or <code>DBL_MAX</code> if there is no time limit. */
+static double searchDeadline = DBL_MAX;
+
+/** @brief When post-search work has to stop: the end of the time limit, or <code>DBL_MAX</code> if there is none. */
+static double postSearchDeadline = DBL_MAX;
+
+/** @brief Set by <code>Globals::cancelSearch()</code>. */
+static std::atomic<bool> searchCancelled(false);
+
+/** @brief Set by <code>Globals::startPostSearchWork()</code>. */
+static std::atomic<bool> searchIsOver(false);
+
+static double secondsOnSteadyClock()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Globals::setTimeLimit(const double & seconds)
+{
+    const double now = secondsOnSteadyClock();
+    searchDeadline = now + seconds * searchShareOfTimeLimit;
+    postSearchDeadline = now + seconds;
+    searchIsOver = false;
+}
+
+void Globals::cancelSearch()
+{
+    searchCancelled = true;
+}
+
+bool Globals::timeToStop()
+{
+    if (searchCancelled) {
+        return true;
+    }
+    const double & deadline = (searchIsOver ? postSearchDeadline : searchDeadline);
+    if (deadline == DBL_MAX) {
+        return false;
+    }
+    return (secondsOnSteadyClock() >= deadline);
+}
+
+bool Globals::searchWasCancelled()
+{
+    return searchCancelled;
+}
+
+void Globals::startPostSearchWork()
+{
+    searchIsOver = true;
+}
+
+std::string Globals::groundingSnapshot;
+
+// FNV-1a: cheap, and unlike std::hash, stable between builds
+unsigned long long Globals::taskFingerprint = 14695981039346656037ULL;
+
+void Globals::addToTaskFingerprint(const char * data, const size_t & length)
+{
+    for (size_t i = 0; i < length; ++i) {
+        taskFingerprint ^= (unsigned char) data[i];
+        taskFingerprint *= 1099511628211ULL;
+    }
+}
+
 }
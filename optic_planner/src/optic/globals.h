@@ -36,6 +36,7 @@
 #include <cmath>
 #include <climits>
 #include <cfloat>
+#include <string>
 
 #ifndef POPF3ANALYSIS
 #define POPF3ANALYSIS
@@ -501,7 +502,47 @@ public:
     
     #endif
 
-    static int timeLimit;
+    /** @brief Set a wall-clock time limit, in seconds from now, after which search stops and returns the best plan found.
+     *
+     *  Search stops once 80% of the limit has passed, leaving the rest for post-search work on the plan it
+     *  returns, such as rescheduling it with <code>-Q</code>: see <code>startPostSearchWork()</code>.
+     */
+    static void setTimeLimit(const double & seconds);
+
+    /** @brief Ask search to stop as soon as it can, returning the best plan found so far.
+     *
+     *  This only sets a flag, so is safe to call from another thread or from a signal handler.
+     */
+    static void cancelSearch();
+
+    /** @brief Return <code>true</code> if the time limit has passed, or search has been cancelled.
+     *
+     *  This is cheap enough to poll from within heuristic evaluation and the MILP solver, not just
+     *  between expansions.
+     */
+    static bool timeToStop();
+
+    /** @brief Return <code>true</code> if <code>cancelSearch()</code> has been called. */
+    static bool searchWasCancelled();
+
+    /** @brief Once search has returned its plan, have <code>timeToStop()</code> wait for all of the time limit, not 80% of it.
+     *
+     *  Post-search work, such as rescheduling the plan for <code>-Q</code>, uses the same LP and RPG code as
+     *  search, so it too stops if cancelled or out of time: it should then return the plan as found.
+     */
+    static void startPostSearchWork();
+
+    /** @brief If non-empty, a snapshot file to read the ground actions from, or to save them to (pass <code>-j&lt;file&gt;</code>).
+     *
+     *  @see instantiatedOp::instantiateFromSnapshot
+     */
+    static std::string groundingSnapshot;
+
+    /** @brief A fingerprint of the text of the domain and problem, identifying the task in grounding snapshots. */
+    static unsigned long long taskFingerprint;
+
+    /** @brief Add the given text of the domain or problem to <code>taskFingerprint</code>. */
+    static void addToTaskFingerprint(const char * data, const size_t & length);
 
     
     /** @brief  If <code>true</code>, search is totally ordered. */
@@ -34,6 +34,7 @@
 #include "PreferenceHandler.h"
 #include "PreferenceData.h"
 #include "RPGBuilder.h"
+#include "searchprofile.h"
 
 /*#include "ClpSimplex.hpp"
 #include "CoinHelperFunctions.hpp"
@@ -3104,6 +3105,7 @@ LPScheduler::LPScheduler(const MinimalState & theState,
                          list<int> * tilComesBefore,
                          const bool & setObjectiveToMetric) : cd(0)
 {
+    SearchProfile::Timer profileTimer(SearchProfile::E_LP_SCHEDULING);
 
     if (!initialised) initialise();
 
@@ -8119,8 +8121,9 @@ LPScheduler::~LPScheduler()
     delete cd;
 };
 
-void LPScheduler::removeExpiredAbstractFacts(StateFacts & facts)
+void LPScheduler::removeExpiredAbstractFacts(MinimalState & state)
 {
+    StateFacts & facts = state.first;
     
     map<int, AbstractFactConstraintBlock>::iterator factItr = planStepForAbstractFact.begin();
     const map<int, AbstractFactConstraintBlock>::iterator factEnd = planStepForAbstractFact.end();
@@ -8132,7 +8135,9 @@ void LPScheduler::removeExpiredAbstractFacts(StateFacts & facts)
             if (lpDebug & 1) {
                 cout << COLOUR_light_red << "Abstract fact " << *(RPGBuilder::getLiteral(factItr->first)) << " is no longer available, removing from state\n" << COLOUR_default;
             }
-            facts.erase(factItr->first);
+            if (facts.erase(factItr->first)) {
+                state.toggleFactInHash(factItr->first);
+            }
         } else {
             
             if (lpDebug & 1) {
@@ -960,7 +960,7 @@ public:
         return solved;
     };
 
-    void removeExpiredAbstractFacts(StateFacts & facts);
+    void removeExpiredAbstractFacts(MinimalState & state);
     
     /** @brief Update the bounds on the task variables in the state reached by the plan so far.
      *
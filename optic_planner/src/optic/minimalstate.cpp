@@ -37,6 +37,7 @@ using std::endl;
 
 #include <cstring>
 #include "RPGBuilder.h"
+#include "objectpool.h"
 
 #include <sstream>
 
@@ -177,11 +178,18 @@ MinimalState::MinimalState(const StateFacts & f,
                            ,const int * const literalGoalStepsIn, int** const numericGoalStepsIn
 #endif                                                      
                            )
-        : first(f), secondMin(sMin), secondMax(sMax), startedActions(sa),
+        : first(f), factsHash(0), secondMin(sMin), secondMax(sMax), startedActions(sa),
           preferenceStatus(ps), prefPreconditionViolations(ppv), lowerBoundOnTimeDependentRewardFacts(tdrStatus ? new double[NumericAnalysis::getFactsInTimeDependentRewards().size()] : 0),
           planLength(pl), actionsExecuting(ae), nextTIL(nt), temporalConstraints(globalTransformer->emptyTemporalConstraints())/*,
           statusOfTemporalPreferences(psa ? psa->clone() : 0)*/
 {
+    {
+        StateFacts::const_iterator fItr = first.begin();
+        const StateFacts::const_iterator fEnd = first.end();
+        for (; fItr != fEnd; ++fItr) {
+            toggleFactInHash(FACTA(fItr));
+        }
+    }
     
     if (tdrStatus) {
         memcpy(lowerBoundOnTimeDependentRewardFacts, tdrStatus, sizeof(double) * NumericAnalysis::getFactsInTimeDependentRewards().size());
@@ -200,7 +208,7 @@ MinimalState::MinimalState(const set<int> & f, const vector<double> & sMin, cons
                            ,const int * const literalGoalStepsIn, int** const numericGoalStepsIn
                            #endif
                            )
-        : secondMin(sMin), secondMax(sMax), startedActions(sa),
+        : factsHash(0), secondMin(sMin), secondMax(sMax), startedActions(sa),
           preferenceStatus(ps), prefPreconditionViolations(ppv), lowerBoundOnTimeDependentRewardFacts(tdrStatus ? new double[NumericAnalysis::getFactsInTimeDependentRewards().size()] : 0),// cost(sc),        
           planLength(pl), actionsExecuting(ae), nextTIL(nt), temporalConstraints(globalTransformer->emptyTemporalConstraints())/*,
           statusOfTemporalPreferences(psa ? psa->clone() : 0)*/
@@ -241,6 +249,7 @@ MinimalState::MinimalState(const MinimalState & other, const int extendBy)
         #else
         first(other.first), retired(other.retired),
         #endif
+        factsHash(other.factsHash),
         secondMin(other.secondMin), secondMax(other.secondMax), startedActions(other.startedActions),
         preferenceStatus(other.preferenceStatus), prefPreconditionViolations(other.prefPreconditionViolations),
         lowerBoundOnTimeDependentRewardFacts(other.lowerBoundOnTimeDependentRewardFacts ? new double[NumericAnalysis::getFactsInTimeDependentRewards().size()] : 0),// cost(other.cost),        
@@ -257,7 +266,7 @@ MinimalState::MinimalState(const MinimalState & other, const int extendBy)
 }
 
 MinimalState::MinimalState()
-    : prefPreconditionViolations(0.0), lowerBoundOnTimeDependentRewardFacts(0), // cost(0.0),
+    : factsHash(0), prefPreconditionViolations(0.0), lowerBoundOnTimeDependentRewardFacts(0), // cost(0.0),
     planLength(0), actionsExecuting(0), nextTIL(0),
     temporalConstraints(globalTransformer->emptyTemporalConstraints())/*,
     statusOfTemporalPreferences(0)*/
@@ -278,6 +287,36 @@ MinimalState::~MinimalState()
     #endif
 }
 
+/** @brief Never deleted, so states deleted during static destruction still have somewhere to go. */
+static FixedSizePool & minimalStatePool()
+{
+    static FixedSizePool * const pool = new FixedSizePool(sizeof(MinimalState));
+    return *pool;
+}
+
+void * MinimalState::operator new(size_t size)
+{
+    if (size != sizeof(MinimalState)) {
+        return ::operator new(size);
+    }
+    return minimalStatePool().allocate();
+}
+
+void MinimalState::operator delete(void * p, size_t size)
+{
+    if (!p) return;
+    if (size != sizeof(MinimalState)) {
+        ::operator delete(p);
+        return;
+    }
+    minimalStatePool().deallocate(p);
+}
+
+void MinimalState::releasePooledMemory()
+{
+    minimalStatePool().releaseIfUnused();
+}
+
 MinimalState & MinimalState::operator =(const MinimalState & other)
 {
     #ifdef TOTALORDERSTATES
@@ -288,6 +327,7 @@ MinimalState & MinimalState::operator =(const MinimalState & other)
     first = other.first;
     retired = other.retired;    
     #endif
+    factsHash = other.factsHash;
     secondMin = other.secondMin;
     secondMax = other.secondMax;
     startedActions = other.startedActions;
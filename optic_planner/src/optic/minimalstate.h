@@ -458,6 +458,15 @@ public:
     }
 };*/
 
+/** @brief A fixed pseudo-random 64-bit key for <code>x</code>, as used in Zobrist hashing (the splitmix64 finaliser). */
+inline unsigned long long zobristKey(unsigned long long x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
 class MinimalState
 {
 
@@ -485,6 +494,19 @@ public:
     StateFacts first;
     StateFacts retired;
     #endif
+
+    /** @brief The XOR of the <code>zobristKey()</code> of each fact in <code>first</code>.
+     *
+     *  This is kept up to date as facts are added and deleted, so the closed list can hash a state
+     *  without visiting all its facts: anything adding a fact to, or erasing one from, <code>first</code>
+     *  must call <code>toggleFactInHash()</code>.
+     */
+    unsigned long long factsHash;
+
+    void toggleFactInHash(const int & fact) {
+        factsHash ^= zobristKey(fact);
+    }
+
     vector<double> secondMin;
     vector<double> secondMax;
     map<int, set<int> > startedActions;
@@ -556,7 +578,9 @@ public:
     void insertFacts(_InputIterator begin, const _InputIterator & end, const StepAndBeforeOrAfter &) {
         StateFacts::iterator insItr = first.end();
         for (; begin != end; ++begin) {
+            const size_t sizeBefore = first.size();
             insItr = first.insert(insItr, (*begin)->getStateID());
+            if (first.size() != sizeBefore) toggleFactInHash(*insItr);
         }
         
     };
@@ -566,7 +590,9 @@ public:
 
         StateFacts::iterator insItr = first.end();
         for (; begin != end; ++begin) {
+            const size_t sizeBefore = first.size();
             insItr = first.insert(insItr, *begin);
+            if (first.size() != sizeBefore) toggleFactInHash(*insItr);
         }
         
         
@@ -578,8 +604,10 @@ public:
     void insertFacts(_InputIterator begin, const _InputIterator & end, const StepAndBeforeOrAfter & from) {
         StateFacts::iterator insItr = first.end();
         for (; begin != end; ++begin) {
+            const size_t sizeBefore = first.size();
             insItr = first.insert(insItr, make_pair((*begin)->getStateID(), PropositionAnnotation(from)));
             insItr->second.availableFrom = from;
+            if (first.size() != sizeBefore) toggleFactInHash(insItr->first);
         }
 
     };
@@ -588,8 +616,10 @@ public:
     void insertIntFacts(_InputIterator begin, const _InputIterator & end, const StepAndBeforeOrAfter & from) {
         StateFacts::iterator insItr = first.end();
         for (; begin != end; ++begin) {
+            const size_t sizeBefore = first.size();
             insItr = first.insert(insItr, make_pair(*begin, PropositionAnnotation(from)));
             insItr->second.availableFrom = from;
+            if (first.size() != sizeBefore) toggleFactInHash(insItr->first);
         }
 
     };
@@ -599,6 +629,13 @@ public:
     MinimalState();
     virtual ~MinimalState();
 
+    /** @brief The state object itself is allocated from a <code>FixedSizePool</code>; its fact maps and vectors are not. */
+    static void * operator new(size_t size);
+    static void operator delete(void * p, size_t size);
+
+    /** @brief Return the pool's memory to the heap, if no states at all are left: called once search is over. */
+    static void releasePooledMemory();
+
     /**
      *  Specify a <code>StateTransformer</code> object to use to handle applying actions to states, and updating
      *  the recorded temporal constraints.
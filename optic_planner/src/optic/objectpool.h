@@ -0,0 +1,134 @@
+/************************************************************************
+ * This file is part of OPTIC.
+ *
+ * OPTIC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * OPTIC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OPTIC.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ************************************************************************/
+
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+/** @file objectpool.h
+ *  @brief A pool of fixed-size blocks, for the objects search creates and deletes by the million.
+ *
+ *  Only the objects themselves come from the pool: any containers they hold still allocate their
+ *  storage from the heap.
+ */
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace Planner
+{
+
+/** @brief Hands out blocks of a single size, carved from chunks allocated a few thousand at a time.
+ *
+ *  Freed blocks go on a free list, to be handed out again, rather than back to the heap.  This saves one heap
+ *  allocation per object, not the allocations made by the object's members.  Chunks are only returned to the
+ *  heap by <code>releaseIfUnused()</code>, and only if none of the blocks are in use: a single long-lived
+ *  object keeps every chunk of its pool alive.  A pool is
+ *  meant to back a class's own <code>operator new</code> and <code>operator delete</code>, and like the rest
+ *  of search, is not thread-safe.
+ */
+class FixedSizePool
+{
+
+private:
+
+    struct FreeBlock {
+        FreeBlock * next;
+    };
+
+    /** @brief The size of each block, rounded up so every block is aligned for any object. */
+    const size_t blockSize;
+
+    std::vector<char*> chunks;
+    FreeBlock * freeList;
+
+    /** @brief How many blocks have been handed out and not yet freed. */
+    size_t inUse;
+
+    /** @brief How many blocks the next chunk holds: this doubles with each chunk, up to <code>maxChunkBlocks</code>. */
+    size_t nextChunkBlocks;
+
+    static const size_t firstChunkBlocks = 64;
+    static const size_t maxChunkBlocks = 4096;
+
+    static size_t roundedSize(const size_t & size) {
+        const size_t alignment = alignof(std::max_align_t);
+        const size_t atLeast = (size < sizeof(FreeBlock) ? sizeof(FreeBlock) : size);
+        return ((atLeast + alignment - 1) / alignment) * alignment;
+    }
+
+    void addChunk() {
+        char * const chunk = static_cast<char*>(::operator new(blockSize * nextChunkBlocks));
+        chunks.push_back(chunk);
+
+        for (size_t b = nextChunkBlocks; b > 0; --b) {
+            FreeBlock * const block = reinterpret_cast<FreeBlock*>(chunk + (b - 1) * blockSize);
+            block->next = freeList;
+            freeList = block;
+        }
+
+        if (nextChunkBlocks < maxChunkBlocks) {
+            nextChunkBlocks *= 2;
+        }
+    }
+
+    FixedSizePool(const FixedSizePool &);
+    FixedSizePool & operator=(const FixedSizePool &);
+
+public:
+
+    FixedSizePool(const size_t & objectSize)
+        : blockSize(roundedSize(objectSize)), freeList(0), inUse(0), nextChunkBlocks(firstChunkBlocks) {
+    }
+
+    void * allocate() {
+        if (!freeList) {
+            addChunk();
+        }
+        FreeBlock * const toReturn = freeList;
+        freeList = freeList->next;
+        ++inUse;
+        return toReturn;
+    }
+
+    void deallocate(void * const p) {
+        FreeBlock * const block = static_cast<FreeBlock*>(p);
+        block->next = freeList;
+        freeList = block;
+        --inUse;
+    }
+
+    /** @brief If no blocks are in use, return all the chunks to the heap; otherwise, do nothing. */
+    void releaseIfUnused() {
+        if (inUse) return;
+
+        std::vector<char*>::iterator cItr = chunks.begin();
+        const std::vector<char*>::iterator cEnd = chunks.end();
+        for (; cItr != cEnd; ++cItr) {
+            ::operator delete(*cItr);
+        }
+
+        chunks.clear();
+        freeList = 0;
+        nextChunkBlocks = firstChunkBlocks;
+    }
+};
+
+};
+
+#endif
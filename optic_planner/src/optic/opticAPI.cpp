@@ -0,0 +1,1256 @@
+/************************************************************************
+ * This file is part of OPTIC.
+ *
+ * OPTIC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * OPTIC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OPTIC.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ************************************************************************/
+
+#include "opticAPI.h"
+#include "opticWorker.h"
+
+#include "ptree.h"
+#include "instantiation.h"
+#include "typecheck.h"
+#include "TIM.h"
+#include "FuncAnalysis.h"
+
+#include "RPGBuilder.h"
+#include "FFSolver.h"
+#include "globals.h"
+#include "totalordertransformer.h"
+#include "partialordertransformer.h"
+#include "lpscheduler.h"
+#include "numericanalysis.h"
+#include "temporalanalysis.h"
+#include "PreferenceHandler.h"
+#include "searchprofile.h"
+
+#include <ament_index_cpp/get_package_prefix.hpp>
+
+#ifdef STOCHASTICDURATIONS
+#include "StochasticDurations.h"
+#endif
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <sstream>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using std::cerr;
+using std::endl;
+using std::istringstream;
+using std::ostringstream;
+
+using namespace TIM;
+using namespace Inst;
+using namespace VAL;
+
+namespace Planner
+{
+
+static const char * const weightError = "Error: must specify weight after W, e.g. -W5, or specify a weight and restart weight reduction, e.g. -W5,1, optionally reusing the search as the weight is reduced, e.g. -W5,1,a\n";
+
+CommandLineResult processCommandLineSwitch(const char * const arg, CommandLineOptions & options)
+{
+    switch (arg[1]) {
+    #ifdef POPF3ANALYSIS
+    case 'l': {
+        NumericAnalysis::doGoalLimitAnalysis = false;
+        break;
+    }
+    #endif
+    case ']': {
+        RPGHeuristic::alwaysExpandFully = true;
+        break;
+    }
+    case '[': {
+        RPGHeuristic::addTheMaxCosts = true;
+        cout << "Warning: assuming max costs are additive-max safe\n";
+        break;
+    }
+    case '2': {
+        RPGBuilder::noSelfOverlaps = true;
+        break;
+    }
+    case 'D': {
+        Globals::paranoidScheduling = true;
+        break;
+    }
+    case 'd': {
+        FF::nonDeletorsFirst = true;
+        break;
+    }
+    case 'P': {
+        if (arg[2] == 0) {
+            Globals::profileScheduling = true;
+        } else {
+            SearchProfile::setOutputFile(&(arg[2]));
+        }
+        break;
+    }
+    case 'A': {
+        RPGHeuristic::estimateCosts = false;
+        break;
+    }
+    case 'a': {
+        FF::costOptimalAStar = true;
+        break;
+    }
+    case 'g': {
+        RPGHeuristic::setGuidance(&(arg[2]));
+        break;
+    }
+    case '/': {
+        LPScheduler::workOutFactLayerZeroBoundsStraightAfterRecentAction = true;
+        break;
+    }
+    case 'u': {
+        char * end;
+        options.planStreamFd = strtol(&(arg[2]), &end, 10);
+        if (arg[2] == 0 || *end != 0 || options.planStreamFd < 0) {
+            cerr << "Error: must specify a file descriptor after -u, e.g. -u3\n";
+            return E_SWITCH_BAD_ARGUMENT;
+        }
+        break;
+    }
+    case 'j': {
+        Globals::groundingSnapshot = &(arg[2]);
+        if (Globals::groundingSnapshot.empty()) {
+            cerr << "Error: must specify a snapshot file after -j, e.g. -jgrounding.snap\n";
+            return E_SWITCH_BAD_ARGUMENT;
+        }
+        break;
+    }
+    case 'G': {
+        FF::biasG = true;
+        break;
+    }
+    case '8': {
+        FF::biasD = true;
+        break;
+    }
+    case 'S': {
+        RPGBuilder::sortedExpansion = true;
+        break;
+    }
+    case '3': {
+        FF::relaxMIP = true;
+        break;
+    }
+    case 'F': {
+        RPGBuilder::fullFFHelpfulActions = true;
+        break;
+    }
+    #ifdef STOCHASTICDURATIONS
+    case 'f': {
+        solutionDeadlineTime = atof(&(arg[2]));
+        break;
+    }
+    case 'M': {
+        options.durationManager = &(arg[2]);
+        break;
+    }
+    #else
+    case 'M': {
+        FF::makespanTieBreak = false;
+        break;
+    }
+    #endif
+    case 'b': {
+        FF::bestFirstSearch = false;
+        break;
+    }
+    case 'B': {
+        options.benchmark = true;
+        break;
+    }
+    case 'e': {
+        FF::steepestDescent = true;
+        break;
+    }
+    case 'E': {
+        FF::skipEHC = true;
+        break;
+    }
+    case 'U': {
+        FF::deferredEvaluation = true;
+        break;
+    }
+    case 'k': {
+        RPGBuilder::doSkipAnalysis = false;
+        break;
+    }
+    case 'm': {
+        if (arg[2] == '2') {
+            FF::openListOrderLowCostFirst = true;
+        } else {
+            FF::openListOrderLowMakespanFirst = true;
+        }
+        break;
+    }
+    case 'c': {
+        RPGBuilder::modifiedRPG = false;
+        break;
+    }
+    case 'C': {
+        FF::allowCompressionSafeScheduler = true;
+        break;
+    }
+    #ifdef ENABLE_DEBUGGING_HOOKS
+    case 'H': {
+        options.debugPreprocessing = true;
+        break;
+    }
+    #endif
+    case 'h': {
+        if (arg[2] == 0) {
+            FF::helpfulActions = false;
+        } else {
+            istringstream conv(&(arg[2]));
+            if (!(conv >> FF::preferredQueueBoost) || FF::preferredQueueBoost < 0 || !conv.eof()) {
+                cerr << "Error: the boost given with -h must be a non-negative whole number, e.g. -h1000\n";
+                return E_SWITCH_BAD_ARGUMENT;
+            }
+            FF::preferredQueue = true;
+        }
+        break;
+    }
+    case 'i': {
+        FF::firstImprover = true;
+        break;
+    }
+    case 'O': {
+        FF::startsBeforeEnds = false;
+        break;
+    }
+    case 'o': {
+        LPScheduler::optimiseOrdering = false;
+        break;
+    }
+    case 'p': {
+        FF::pruneMemoised = false;
+        break;
+    }
+    case 'R': {
+        FF::invariantRPG = true;
+        break;
+    }
+    case 'q': {
+        FF::useDominanceConstraintsInStateHash = true;
+        break;
+    }
+    case 'x': {
+        if (arg[2] == 0) {
+            cerr << "Error: must specify a time limit after -x, e.g. -x1800\n";
+            return E_SWITCH_BAD_ARGUMENT;
+        }
+        cout << "Time limit: " << atof(&(arg[2])) << endl;
+        Globals::setTimeLimit(atof(&(arg[2])));
+        break;
+    }
+    case 'T': {
+        Globals::totalOrder = true;
+        RPGBuilder::modifiedRPG = false;
+        FF::tsChecking = true;
+        if (arg[2] == 'T') {
+            options.postHocTotalOrder = true;
+        }
+        break;
+    }
+    case 't': {
+        FF::tsChecking = false;
+        break;
+    }
+    case 'X': {
+        NumericAnalysis::readBounds = true;
+        break;
+    }
+    case 'Q': {
+        options.postHocScheduleToMetric = true;
+        break;
+    }
+    case 'v': {
+        if (arg[2] == 'p') {
+            PreferenceHandler::preferenceDebug = true;
+        } else if (arg[2] != 0) {
+            Globals::writeableVerbosity = atoi(&(arg[2]));
+        } else {
+            cout << "No verbosity level specified with -v, defaulting to 1\n";
+            Globals::writeableVerbosity = 1;
+        }
+        break;
+    }
+    case 'L': {
+        if (arg[2] != 0) {
+            LPScheduler::lpDebug = atoi(&(arg[2]));
+        } else {
+            LPScheduler::lpDebug = 255;
+        }
+        break;
+    }
+    case 'W': {
+        string Warg(&(arg[2]));
+        if (Warg.empty()) {
+            cerr << weightError;
+            return E_SWITCH_BAD_ARGUMENT;
+        }
+        const int commaAt = Warg.find(',');
+        if (commaAt == string::npos) {
+            istringstream conv(Warg);
+            if (!(conv >> FF::doubleU)) {
+                cerr << weightError;
+                return E_SWITCH_BAD_ARGUMENT;
+            }
+        } else {
+            const string W = Warg.substr(0,commaAt);
+            {
+                istringstream conv(W);
+                if (!(conv >> FF::doubleU)) {
+                    cerr << weightError;
+                    return E_SWITCH_BAD_ARGUMENT;
+                }
+            }
+            string WR = Warg.substr(commaAt + 1);
+            const size_t secondCommaAt = WR.find(',');
+            if (secondCommaAt != string::npos) {
+                if (WR.substr(secondCommaAt + 1) != "a") {
+                    cerr << weightError;
+                    return E_SWITCH_BAD_ARGUMENT;
+                }
+                FF::reuseSearchAcrossWeights = true;
+                WR = WR.substr(0, secondCommaAt);
+            }
+            {
+                istringstream conv(WR);
+                if (!(conv >> FF::doubleUReduction)) {
+                    cerr << weightError;
+                    return E_SWITCH_BAD_ARGUMENT;
+                }
+            }
+        }
+        break;
+    }
+    case 'w': {
+        RPGHeuristic::orderByDeadlineRelevance = true;
+        break;
+    }
+    case 'I': {
+        LPScheduler::hybridBFLP = false;
+        break;
+    }
+    case 'y': {
+        options.outputFilePath = &(arg[2]);
+        break;
+    }
+    case 'K': {
+        if (arg[2] == 0) {
+            cerr << "Error: must specify search switches after -K, e.g. -K\"-W5,1 -h\"\n";
+            return E_SWITCH_BAD_ARGUMENT;
+        }
+        options.portfolio.push_back(&(arg[2]));
+        break;
+    }
+    case 'J': {
+        if (arg[2] == 0) {
+            cerr << "Error: must specify a file after -J, e.g. -Jplan.json\n";
+            return E_SWITCH_BAD_ARGUMENT;
+        }
+        options.jsonOutputFilePath = &(arg[2]);
+        break;
+    }
+    case 'r': {
+        options.readInAPlan = true;
+        #ifdef POPF3ANALYSIS
+        if (arg[2] != 0) {
+            FF::reprocessQualityBound = atof(&(arg[2]));
+        }
+        #endif
+        break;
+    }
+    case '0': {
+        TemporalAnalysis::abstractTILsWherePossible = true;
+        LPScheduler::hybridBFLP = false;
+        break;
+    }
+    case 's': {
+        FF::planMustSucceed = true;
+        break;
+    }
+    case 'z': {
+        FF::zealousEHC = false;
+        break;
+    }
+    case 'Z': {
+        RPGHeuristic::printRPGAsDot = true;
+        break;
+    }
+    #ifdef POPF3ANALYSIS
+    case 'n': {
+        Globals::optimiseSolutionQuality = true;
+        if (arg[2] != 0) {
+            Globals::givenSolutionQualityDefined = true;
+            Globals::givenSolutionQuality = atof(&(arg[2]));
+        }
+        break;
+    }
+    case 'N': {
+        Globals::optimiseSolutionQuality = false;
+        break;
+    }
+    case '>': {
+        Globals::improvementBetweenSolutions = atof(&(arg[2]));
+        break;
+    }
+    #endif
+    default:
+        cout << "Unrecognised command-line switch '" << arg[1] << "'\n";
+        return E_SWITCH_UNRECOGNISED;
+    }
+
+    return E_SWITCH_OK;
+}
+
+void setCommandLineDefaults()
+{
+    FAverbose = false;
+
+    FF::steepestDescent = false;
+    FF::incrementalExpansion = false;
+    FF::invariantRPG = false;
+    FF::timeWAStar = false;
+    LPScheduler::hybridBFLP = false;
+}
+
+void initialisePlanner(const CommandLineOptions & options)
+{
+    #ifdef STOCHASTICDURATIONS
+    setDurationManager(options.durationManager.c_str());
+    #endif
+
+    #ifdef TOTALORDERSTATES
+    MinimalState::setTransformer(new TotalOrderTransformer());
+    #else
+    if (Globals::totalOrder) {
+        MinimalState::setTransformer(new TotalOrderTransformer());
+    } else {
+        MinimalState::setTransformer(new PartialOrderTransformer());
+    }
+    #endif
+
+    #ifdef POPF3ANALYSIS
+    const bool realOpt = Globals::optimiseSolutionQuality;
+    Globals::optimiseSolutionQuality = (Globals::optimiseSolutionQuality || options.postHocScheduleToMetric);
+    #endif
+
+    RPGBuilder::initialise();
+
+    #ifdef POPF3ANALYSIS
+    Globals::optimiseSolutionQuality = realOpt;
+    #endif
+
+    #ifdef STOCHASTICDURATIONS
+    initialiseDistributions();
+    setSolutionDeadlineTimeToLatestGoal();
+    #endif
+
+    if (Globals::optimiseSolutionQuality && Globals::givenSolutionQualityDefined) {
+        if (RPGBuilder::getMetric()) {
+            cout << "Forcing the use of the given solution quality of " << Globals::givenSolutionQuality << endl;
+            if (RPGBuilder::getMetric()->minimise) {
+                Globals::bestSolutionQuality = (Globals::givenSolutionQuality == 0.0 ? 0.0 : -Globals::givenSolutionQuality);
+            } else {
+                Globals::bestSolutionQuality = Globals::givenSolutionQuality;
+            }
+
+            RPGBuilder::getHeuristic()->metricHasChanged();
+        }
+    }
+}
+
+vector<string> splitArguments(const string & arguments)
+{
+    vector<string> toReturn;
+    istringstream conv(arguments);
+    string arg;
+    while (conv >> arg) {
+        toReturn.push_back(arg);
+    }
+    return toReturn;
+}
+
+/** @brief Collate the start steps of a plan, in the order <code>FFEvent::printPlan</code> prints them. */
+static void collatePlanSteps(const list<FFEvent> & plan, vector<PlanStep> & steps)
+{
+    const int planSize = plan.size();
+    vector<double> endTS(planSize);
+    vector<const FFEvent*> planVector(planSize);
+    map<double, list<int> > sorted;
+
+    list<FFEvent>::const_iterator planItr = plan.begin();
+    const list<FFEvent>::const_iterator planEnd = plan.end();
+
+    for (int i = 0; planItr != planEnd; ++planItr, ++i) {
+        if (planItr->isDummyStep()) {
+            continue;
+        }
+        if (planItr->time_spec == Planner::E_AT_START) {
+            sorted[planItr->lpTimestamp].push_back(i);
+            planVector[i] = &(*planItr);
+        } else if (planItr->time_spec == Planner::E_AT_END) {
+            endTS[i] = planItr->lpTimestamp;
+        }
+    }
+
+    map<double, list<int> >::const_iterator sortedItr = sorted.begin();
+    const map<double, list<int> >::const_iterator sortedEnd = sorted.end();
+
+    for (; sortedItr != sortedEnd; ++sortedItr) {
+        list<int>::const_iterator iItr = sortedItr->second.begin();
+        const list<int>::const_iterator iEnd = sortedItr->second.end();
+
+        for (; iItr != iEnd; ++iItr) {
+            const FFEvent * const step = planVector[*iItr];
+
+            ostringstream actionName;
+            actionName << *(step->action);
+
+            double duration;
+            if (step->pairWithStep >= 0) {
+                duration = endTS[step->pairWithStep] - step->lpTimestamp;
+            } else {
+                duration = RPGBuilder::getNonTemporalDurationToPrint()[step->action->getID()];
+            }
+
+            steps.push_back(PlanStep(step->lpTimestamp < 0.0000001 ? 0.0 : step->lpTimestamp, actionName.str(), duration));
+
+            PlanStep & added = steps.back();
+            added.actionID = step->action->getID();
+            added.operatorName = step->action->getHead()->getName();
+            const int arity = step->action->arity();
+            added.parameters.reserve(arity);
+            for (int p = 0; p < arity; ++p) {
+                added.parameters.push_back(step->action->getArg(p)->getName());
+            }
+        }
+    }
+}
+
+void describeSolution(const Solution & solution, PlanResult & result)
+{
+    result.solved = true;
+    result.quality = solution.quality;
+    result.statesEvaluated = RPGHeuristic::statesEvaluated;
+    collatePlanSteps(*(solution.plan), result.steps);
+}
+
+/** @brief Write a string as a JSON string literal. */
+static void writeJSONString(ostream & o, const string & s)
+{
+    o << '"';
+    const size_t length = s.size();
+    for (size_t c = 0; c < length; ++c) {
+        const unsigned char ch = s[c];
+        switch (ch) {
+        case '"':
+            o << "\\\"";
+            break;
+        case '\\':
+            o << "\\\\";
+            break;
+        case '\n':
+            o << "\\n";
+            break;
+        case '\t':
+            o << "\\t";
+            break;
+        default:
+            if (ch < 0x20) {
+                o << "\\u00" << "0123456789abcdef"[ch >> 4] << "0123456789abcdef"[ch & 15];
+            } else {
+                o << ch;
+            }
+        }
+    }
+    o << '"';
+}
+
+void writePlanAsJSON(ostream & o, const PlanResult & result)
+{
+    ostringstream json;
+    json << std::setprecision(std::numeric_limits<double>::max_digits10);
+
+    json << "{\"solved\":" << (result.solved ? "true" : "false")
+         << ",\"quality\":" << result.quality
+         << ",\"statesEvaluated\":" << result.statesEvaluated
+         << ",\"error\":";
+    writeJSONString(json, result.error);
+    json << ",\"steps\":[";
+
+    const size_t stepCount = result.steps.size();
+    for (size_t s = 0; s < stepCount; ++s) {
+        const PlanStep & step = result.steps[s];
+        if (s) json << ",";
+        json << "{\"index\":" << s
+             << ",\"time\":" << step.time
+             << ",\"duration\":" << step.duration
+             << ",\"actionID\":" << step.actionID
+             << ",\"action\":";
+        writeJSONString(json, step.action);
+        json << ",\"operator\":";
+        writeJSONString(json, step.operatorName);
+        json << ",\"parameters\":[";
+        const size_t parameterCount = step.parameters.size();
+        for (size_t p = 0; p < parameterCount; ++p) {
+            if (p) json << ",";
+            writeJSONString(json, step.parameters[p]);
+        }
+        json << "]}";
+    }
+    json << "]}\n";
+
+    o << json.str();
+}
+
+/** @brief The domain given to <code>parseDomainInAdvance()</code>, if it has been called. */
+static string * domainParsedInAdvance = 0;
+
+void parseDomainInAdvance(const string & domain)
+{
+    assert(!domainParsedInAdvance);
+    domainParsedInAdvance = new string(domain);
+    parseAndTypeCheckTIMDomain(domainParsedInAdvance->data(), domainParsedInAdvance->size());
+}
+
+/** @brief Where to pass improved plans to, whilst searching. */
+static const PlanCallback * improvedPlanCallback = 0;
+
+/** @brief Registered as <code>FF::newBestSolution</code>, to pass each improved plan to <code>improvedPlanCallback</code>. */
+static void reportImprovedPlan(const Solution & solution)
+{
+    PlanResult improved;
+    describeSolution(solution, improved);
+
+    (*improvedPlanCallback)(improved);
+}
+
+void streamImprovedPlans(const int & fd)
+{
+    static WorkerChannel * const stream = new WorkerChannel(fd);
+    static const PlanCallback writeToStream = [](const PlanResult & improved) {
+        stream->writeFrame(WorkerChannel::E_IMPROVED_PLAN_FRAME, improved);
+    };
+
+    improvedPlanCallback = &writeToStream;
+    FF::newBestSolution = reportImprovedPlan;
+}
+
+void writeStructuredPlan(const Solution & solution, const CommandLineOptions & options)
+{
+    if (options.planStreamFd < 0 && options.jsonOutputFilePath.empty()) {
+        return;
+    }
+
+    PlanResult result;
+    if (solution.plan) {
+        describeSolution(solution, result);
+    } else {
+        result.statesEvaluated = RPGHeuristic::statesEvaluated;
+        result.error = "Problem unsolvable";
+    }
+
+    writeStructuredPlan(result, options);
+}
+
+void writeStructuredPlan(const PlanResult & result, const CommandLineOptions & options)
+{
+    if (options.planStreamFd >= 0) {
+        WorkerChannel stream(options.planStreamFd);
+        stream.writeFrame(WorkerChannel::E_RESULT_FRAME, result);
+    }
+
+    if (!options.jsonOutputFilePath.empty()) {
+        std::ofstream jsonFile(options.jsonOutputFilePath.c_str());
+        if (jsonFile.is_open()) {
+            writePlanAsJSON(jsonFile, result);
+        } else {
+            cerr << "Error: could not write the plan to " << options.jsonOutputFilePath << endl;
+        }
+    }
+}
+
+void scheduleSolutionToMetric(Solution & solution, const CommandLineOptions & options)
+{
+    #ifndef TOTALORDERSTATES
+    // a cancelled search returns its plan as found: see FF::reprocessPlan
+    if (options.postHocScheduleToMetric && solution.plan && !solution.plan->empty() && !Globals::searchWasCancelled()) {
+        if (Globals::totalOrder && !options.postHocTotalOrder) {
+            MinimalState::setTransformer(new PartialOrderTransformer());
+            Globals::totalOrder = false;
+            FF::tsChecking = false;
+        }
+        assert(solution.constraints);
+        solution.plan = FF::reprocessPlan(solution.plan, solution.constraints, &(solution.quality));
+        solution.constraints = 0;
+    }
+    #endif
+}
+
+PlanResult solveInProcess(const PlanRequest & request, const PlanCallback & onImprovedPlan)
+{
+    FF::SearchContext searchContext;
+    const FF::SearchContext::Use useSearchContext(searchContext);
+
+    PlanResult toReturn;
+
+    setCommandLineDefaults();
+
+    CommandLineOptions options;
+
+    vector<string>::const_iterator argItr = request.arguments.begin();
+    const vector<string>::const_iterator argEnd = request.arguments.end();
+
+    for (; argItr != argEnd; ++argItr) {
+        if (argItr->size() < 2 || (*argItr)[0] != '-') {
+            toReturn.error = "Unexpected argument '" + *argItr + "': only switches can be passed to the planner";
+            return toReturn;
+        }
+        if (processCommandLineSwitch(argItr->c_str(), options) != E_SWITCH_OK) {
+            toReturn.error = "Invalid command-line switch '" + *argItr + "'";
+            return toReturn;
+        }
+    }
+
+    if (options.readInAPlan || options.debugPreprocessing) {
+        toReturn.error = "Reading in a plan is only supported by the command-line planner";
+        return toReturn;
+    }
+
+    if (request.timeLimit > 0.0) {
+        Globals::setTimeLimit(request.timeLimit);
+    }
+
+    Globals::addToTaskFingerprint(request.domain.data(), request.domain.size());
+    Globals::addToTaskFingerprint(request.problem.data(), request.problem.size());
+
+    if (domainParsedInAdvance) {
+        if (*domainParsedInAdvance != request.domain) {
+            toReturn.error = "The request is not for the domain this process has already parsed";
+            return toReturn;
+        }
+        performTIMAnalysisOfProblem(request.problem.data(), request.problem.size());
+    } else {
+        performTIMAnalysis(request.domain.data(), request.domain.size(),
+                           request.problem.data(), request.problem.size());
+    }
+
+    cout << std::setprecision(3) << std::fixed;
+
+    initialisePlanner(options);
+
+    if (!options.portfolio.empty()) {
+        searchPortfolio(options, toReturn, onImprovedPlan);
+        return toReturn;
+    }
+
+    bool reachesGoals;
+
+    if (onImprovedPlan) {
+        improvedPlanCallback = &onImprovedPlan;
+        FF::newBestSolution = reportImprovedPlan;
+    }
+
+    Solution planAndConstraints = FF::search(reachesGoals);
+
+    FF::newBestSolution = 0;
+    improvedPlanCallback = 0;
+
+    list<FFEvent> * & spSoln = planAndConstraints.plan;
+
+    if (!spSoln) {
+        toReturn.error = "Problem unsolvable";
+        return toReturn;
+    }
+
+    scheduleSolutionToMetric(planAndConstraints, options);
+
+    describeSolution(planAndConstraints, toReturn);
+
+    return toReturn;
+}
+
+void cancelSearch()
+{
+    Globals::cancelSearch();
+}
+
+/** @brief Handles the signal a <code>PlannerContext</code> sends to its workers to cancel their search. */
+static void cancelOnSignal(int)
+{
+    Globals::cancelSearch();
+}
+
+/** @brief The planner executable workers run, in one of its worker modes.
+ *
+ *  This is the one installed with the <code>optic_planner</code> package found in the ament index at
+ *  the time of the call, unless overridden by the <code>OPTIC_PLANNER_EXECUTABLE</code> environment
+ *  variable.  If neither gives one, the result is empty.
+ */
+static string workerExecutable()
+{
+    const char * const fromEnvironment = getenv("OPTIC_PLANNER_EXECUTABLE");
+    if (fromEnvironment && *fromEnvironment) {
+        return fromEnvironment;
+    }
+    try {
+        return ament_index_cpp::get_package_prefix("optic_planner") + "/lib/optic_planner/optic_planner";
+    } catch (const ament_index_cpp::PackageNotFoundError &) {
+        return string();
+    }
+}
+
+/** @brief Start a worker running the planner executable as <code>optic_planner &lt;mode&gt; &lt;requestFd&gt; &lt;resultFd&gt;</code>.
+ *
+ *  The caller may have other threads, which could hold locks (in the allocator, or in iostreams) at
+ *  the moment of forking, so the child makes only async-signal-safe calls before it execs: all of its
+ *  arguments are built beforehand.  The descriptors given must have been opened close-on-exec, so
+ *  that no other thread's pipes leak into the worker; these two alone are then inherited.
+ *
+ *  @return The worker's process ID, or -1, with <code>errno</code> set, if it could not be forked
+ *          (<code>ENOENT</code> if there is no planner executable to run: see <code>workerExecutable()</code>).
+ */
+static pid_t execWorker(const char * const mode, const int & requestFd, const int & resultFd)
+{
+    const string executable = workerExecutable();
+    if (executable.empty()) {
+        errno = ENOENT;
+        return -1;
+    }
+    const string requestArgument = std::to_string(requestFd);
+    const string resultArgument = std::to_string(resultFd);
+
+    char * const argv[] = {
+        const_cast<char*>(executable.c_str()),
+        const_cast<char*>(mode),
+        const_cast<char*>(requestArgument.c_str()),
+        const_cast<char*>(resultArgument.c_str()),
+        0
+    };
+
+    cout.flush();
+    cerr.flush();
+
+    // keep the cancellation signal pending until the worker has its handler in place: the mask survives exec
+    sigset_t cancelSignal;
+    sigset_t previousMask;
+    sigemptyset(&cancelSignal);
+    sigaddset(&cancelSignal, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &cancelSignal, &previousMask);
+
+    const pid_t pid = fork();
+
+    if (pid == 0) {
+        fcntl(requestFd, F_SETFD, 0);
+        fcntl(resultFd, F_SETFD, 0);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    const int forkError = errno;
+    pthread_sigmask(SIG_SETMASK, &previousMask, 0);
+    errno = forkError;
+
+    return pid;
+}
+
+/** @brief Why a worker that exited with the given status returned no result. */
+static string workerFailure(const int & status)
+{
+    ostringstream error;
+    error << "The planner terminated without returning a result";
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+        error << ": could not run " << workerExecutable();
+        return error.str();
+    }
+    if (WIFEXITED(status)) {
+        error << " (exit status " << WEXITSTATUS(status) << ")";
+    } else if (WIFSIGNALED(status)) {
+        error << " (signal " << WTERMSIG(status) << ")";
+    }
+    error << ": check the domain and problem for errors";
+    return error.str();
+}
+
+/** @brief Solve a request in this process, writing each improved plan and then the result to <code>resultFd</code>.
+ *
+ *  @return The exit status for the worker.
+ */
+static int answerRequest(const PlanRequest & request, const int & resultFd)
+{
+    WorkerChannel out(resultFd);
+
+    const PlanResult result = solveInProcess(request, [&out](const PlanResult & improved) {
+        out.writeFrame(WorkerChannel::E_IMPROVED_PLAN_FRAME, improved);
+    });
+
+    cout.flush();
+    return (out.writeFrame(WorkerChannel::E_RESULT_FRAME, result) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+int runWorker(const int & requestFd, const int & resultFd)
+{
+    struct sigaction cancelAction;
+    memset(&cancelAction, 0, sizeof(cancelAction));
+    cancelAction.sa_handler = cancelOnSignal;
+    sigemptyset(&cancelAction.sa_mask);
+    sigaction(SIGUSR1, &cancelAction, 0);
+
+    sigset_t cancelSignal;
+    sigemptyset(&cancelSignal);
+    sigaddset(&cancelSignal, SIGUSR1);
+    sigprocmask(SIG_UNBLOCK, &cancelSignal, 0);
+
+    PlanRequest request;
+    {
+        WorkerChannel in(requestFd);
+        if (!in.read(request)) {
+            // the context was destroyed before sending a request
+            return EXIT_SUCCESS;
+        }
+        close(requestFd);
+    }
+
+    const int status = answerRequest(request, resultFd);
+    close(resultFd);
+    return status;
+}
+
+int runDomainCheckWorker(const int & requestFd, const int & resultFd)
+{
+    PlanRequest request;
+    {
+        WorkerChannel in(requestFd);
+        if (!in.read(request)) {
+            return EXIT_FAILURE;
+        }
+        close(requestFd);
+    }
+
+    const DomainCheckResult result = checkDomainInProcess(request.domain);
+
+    cout.flush();
+    WorkerChannel out(resultFd);
+    return (out.write(result) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+PlanResult solveInForkedWorker(const PlanRequest & request, const PlanCallback & onImprovedPlan)
+{
+    PlanResult toReturn;
+
+    int resultFds[2];
+    if (pipe2(resultFds, O_CLOEXEC) != 0) {
+        toReturn.error = string("Could not create a pipe to the planner: ") + strerror(errno);
+        return toReturn;
+    }
+
+    cout.flush();
+    cerr.flush();
+
+    const pid_t pid = fork();
+
+    if (pid < 0) {
+        toReturn.error = string("Could not start the planner: ") + strerror(errno);
+        close(resultFds[0]);
+        close(resultFds[1]);
+        return toReturn;
+    }
+
+    if (pid == 0) {
+        close(resultFds[0]);
+        _exit(answerRequest(request, resultFds[1]));
+    }
+
+    close(resultFds[1]);
+
+    WorkerChannel in(resultFds[0]);
+    const bool received = in.readResult(toReturn, onImprovedPlan);
+    close(resultFds[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+
+    if (!received) {
+        toReturn = PlanResult();
+        toReturn.error = workerFailure(status);
+    }
+
+    return toReturn;
+}
+
+PlannerContext::Worker::Worker()
+    : pid(-1), requestFd(-1), resultFd(-1)
+{
+}
+
+PlannerContext::PlannerContext(const vector<string> & defaultArgumentsIn, const bool keepWorkerReadyIn)
+    : defaultArguments(defaultArgumentsIn), keepWorkerReady(keepWorkerReadyIn)
+{
+    if (keepWorkerReady) {
+        string ignore;
+        startWorker(readyWorker, ignore);
+    }
+}
+
+PlannerContext::~PlannerContext()
+{
+    std::lock_guard<std::mutex> guard(contextLock);
+    if (readyWorker.pid > 0) {
+        // closing its request pipe tells the spare worker to exit
+        finishWorker(readyWorker);
+    }
+}
+
+bool PlannerContext::startWorker(Worker & worker, string & error)
+{
+    int requestFds[2];
+    int resultFds[2];
+
+    if (pipe2(requestFds, O_CLOEXEC) != 0) {
+        error = string("Could not create a pipe to the planner: ") + strerror(errno);
+        return false;
+    }
+    if (pipe2(resultFds, O_CLOEXEC) != 0) {
+        error = string("Could not create a pipe to the planner: ") + strerror(errno);
+        close(requestFds[0]);
+        close(requestFds[1]);
+        return false;
+    }
+
+    const pid_t pid = execWorker("--worker", requestFds[0], resultFds[1]);
+
+    if (pid < 0) {
+        error = string("Could not start the planner: ") + strerror(errno);
+    }
+
+    close(requestFds[0]);
+    close(resultFds[1]);
+
+    if (pid < 0) {
+        close(requestFds[1]);
+        close(resultFds[0]);
+        return false;
+    }
+
+    worker.pid = pid;
+    worker.requestFd = requestFds[1];
+    worker.resultFd = resultFds[0];
+
+    return true;
+}
+
+int PlannerContext::finishWorker(Worker & worker)
+{
+    if (worker.requestFd >= 0) {
+        close(worker.requestFd);
+    }
+    if (worker.resultFd >= 0) {
+        close(worker.resultFd);
+    }
+
+    int status = 0;
+    while (waitpid(worker.pid, &status, 0) < 0 && errno == EINTR) {
+    }
+
+    worker = Worker();
+    return status;
+}
+
+DomainCheckResult checkDomainInProcess(const string & domain)
+{
+    DomainCheckResult toReturn;
+
+    ostringstream typeCheckLog;
+    toReturn.valid = checkTIMDomain(domain.data(), domain.size(), typeCheckLog);
+    toReturn.typeCheckLog = typeCheckLog.str();
+
+    parse_error_list::const_iterator errItr = current_analysis->error_list.begin();
+    const parse_error_list::const_iterator errEnd = current_analysis->error_list.end();
+
+    for (; errItr != errEnd; ++errItr) {
+        ParseDiagnostic diagnostic;
+        diagnostic.error = ((*errItr)->getSeverity() == E_FATAL);
+        diagnostic.line = (*errItr)->getLine();
+        diagnostic.description = (*errItr)->getDescription();
+        toReturn.diagnostics.push_back(diagnostic);
+    }
+
+    return toReturn;
+}
+
+DomainCheckResult checkDomain(const string & domain)
+{
+    DomainCheckResult toReturn;
+
+    int requestFds[2];
+    int resultFds[2];
+
+    if (pipe2(requestFds, O_CLOEXEC) != 0) {
+        toReturn.typeCheckLog = string("Could not create a pipe to the parser: ") + strerror(errno);
+        return toReturn;
+    }
+    if (pipe2(resultFds, O_CLOEXEC) != 0) {
+        toReturn.typeCheckLog = string("Could not create a pipe to the parser: ") + strerror(errno);
+        close(requestFds[0]);
+        close(requestFds[1]);
+        return toReturn;
+    }
+
+    const pid_t pid = execWorker("--check-worker", requestFds[0], resultFds[1]);
+
+    if (pid < 0) {
+        toReturn.typeCheckLog = string("Could not start the parser: ") + strerror(errno);
+    }
+
+    close(requestFds[0]);
+    close(resultFds[1]);
+
+    if (pid < 0) {
+        close(requestFds[1]);
+        close(resultFds[0]);
+        return toReturn;
+    }
+
+    PlanRequest request;
+    request.domain = domain;
+
+    {
+        WorkerChannel out(requestFds[1]);
+        out.write(request);
+        close(requestFds[1]);
+    }
+
+    WorkerChannel in(resultFds[0]);
+    if (!in.read(toReturn)) {
+        toReturn = DomainCheckResult();
+        toReturn.typeCheckLog = "The parser terminated without returning a result";
+    }
+
+    close(resultFds[0]);
+
+    while (waitpid(pid, 0, 0) < 0 && errno == EINTR) {
+    }
+
+    return toReturn;
+}
+
+PlanResult PlannerContext::solve(const PlanRequest & requestIn, const PlanCallback & onImprovedPlan)
+{
+    PlanResult toReturn;
+
+    PlanRequest request(requestIn);
+    request.arguments.insert(request.arguments.begin(), defaultArguments.begin(), defaultArguments.end());
+
+    Worker worker;
+    {
+        std::lock_guard<std::mutex> guard(contextLock);
+        if (readyWorker.pid > 0) {
+            worker = readyWorker;
+            readyWorker = Worker();
+        }
+    }
+
+    if (worker.pid <= 0 && !startWorker(worker, toReturn.error)) {
+        return toReturn;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(contextLock);
+        busyWorkers.insert(worker.pid);
+    }
+
+    bool received = false;
+    {
+        WorkerChannel out(worker.requestFd);
+        if (out.write(request)) {
+            // close our end now, so the worker does not wait for more
+            close(worker.requestFd);
+            worker.requestFd = -1;
+        }
+    }
+
+    if (keepWorkerReady) {
+        // fork the next worker whilst this one searches
+        Worker next;
+        string ignore;
+        if (startWorker(next, ignore)) {
+            std::lock_guard<std::mutex> guard(contextLock);
+            if (readyWorker.pid > 0) {
+                finishWorker(next);
+            } else {
+                readyWorker = next;
+            }
+        }
+    }
+
+    if (worker.requestFd == -1) {
+        WorkerChannel in(worker.resultFd);
+        received = in.readResult(toReturn, onImprovedPlan);
+    }
+
+    {
+        // before reaping it, so its process ID cannot have been reused when cancel() signals it
+        std::lock_guard<std::mutex> guard(contextLock);
+        busyWorkers.erase(worker.pid);
+    }
+
+    const int status = finishWorker(worker);
+
+    if (!received) {
+        toReturn = PlanResult();
+        toReturn.error = workerFailure(status);
+    }
+
+    return toReturn;
+}
+
+void PlannerContext::cancel()
+{
+    std::lock_guard<std::mutex> guard(contextLock);
+
+    std::set<int>::const_iterator wItr = busyWorkers.begin();
+    const std::set<int>::const_iterator wEnd = busyWorkers.end();
+
+    for (; wItr != wEnd; ++wItr) {
+        kill(*wItr, SIGUSR1);
+    }
+}
+
+PlanResult solve(const PlanRequest & request, const PlanCallback & onImprovedPlan)
+{
+    PlannerContext context(vector<string>(), false);
+    return context.solve(request, onImprovedPlan);
+}
+
+};
@@ -0,0 +1,351 @@
+/************************************************************************
+ * This file is part of OPTIC.
+ *
+ * OPTIC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * OPTIC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OPTIC.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ************************************************************************/
+
+#ifndef OPTICAPI_H
+#define OPTICAPI_H
+
+/** @file opticAPI.h
+ *  @brief Linkable entry point to the planner, for callers that hold the domain and problem in memory.
+ *
+ *  This header is installed alongside <code>libopticCommon</code>, so it deliberately only
+ *  depends on the standard library: none of the planner's internal headers leak out of it.
+ */
+
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Planner
+{
+
+/** @brief Options set at the command line that are handled by the caller, rather than by the planner's static flags. */
+struct CommandLineOptions {
+
+    /** @brief <code>-B</code>: benchmark the plan found. */
+    bool benchmark;
+
+    /** @brief <code>-r</code>: read in a plan rather than planning. */
+    bool readInAPlan;
+
+    /** @brief <code>-TT</code>: keep the plan totally ordered when post-hoc optimising it. */
+    bool postHocTotalOrder;
+
+    /** @brief <code>-H</code>: read in a plan, to check the preprocessor does not prune its actions. */
+    bool debugPreprocessing;
+
+    /** @brief <code>-Q</code>: reschedule the plan found to optimise the metric. */
+    bool postHocScheduleToMetric;
+
+    /** @brief <code>-y&lt;file&gt;</code>: where to write the plan. */
+    std::string outputFilePath;
+
+    /** @brief <code>-M&lt;name&gt;</code>: the duration manager to use, if stochastic durations are enabled. */
+    std::string durationManager;
+
+    /** @brief <code>-u&lt;fd&gt;</code>: a file descriptor to stream each improved plan to, as it is found, or -1. */
+    int planStreamFd;
+
+    /** @brief <code>-J&lt;file&gt;</code>: where to write the plan as JSON, or empty for nowhere. */
+    std::string jsonOutputFilePath;
+
+    /** @brief <code>-K&lt;switches&gt;</code>, once per configuration: search configurations to run as a portfolio.
+     *
+     *  Each entry holds the search switches of one configuration, separated by spaces, e.g. <code>"-W5,1 -h"</code>.
+     *  They are applied on top of the other switches, once the task has been preprocessed.
+     */
+    std::vector<std::string> portfolio;
+
+    CommandLineOptions()
+        : benchmark(false), readInAPlan(false), postHocTotalOrder(false),
+          debugPreprocessing(false), postHocScheduleToMetric(false),
+          outputFilePath("/tmp/plan.pddl"), durationManager("montecarlo"), planStreamFd(-1)
+    {
+    }
+};
+
+/** @brief Outcome of processing a single command-line switch. */
+enum CommandLineResult {
+    /** @brief The switch was recognised and applied. */
+    E_SWITCH_OK = 0,
+    /** @brief The switch was recognised, but its argument was malformed. */
+    E_SWITCH_BAD_ARGUMENT = 1,
+    /** @brief The switch was not recognised. */
+    E_SWITCH_UNRECOGNISED = 2
+};
+
+/** @brief Apply a single command-line switch, such as <code>-E</code> or <code>-W5,1</code>.
+ *
+ *  Switches that configure search set the corresponding static flags in <code>FF</code>,
+ *  <code>RPGBuilder</code>, <code>LPScheduler</code> and so on, exactly as the command-line planner does.
+ *  Switches that affect what the caller does with the plan are recorded in <code>options</code>.
+ *
+ *  @param arg      The switch, including its leading '-'
+ *  @param options  Caller-level options, updated if <code>arg</code> is one of these
+ *  @return Whether the switch was recognised and well-formed.  Any diagnostic has already been written to <code>cerr</code>.
+ */
+CommandLineResult processCommandLineSwitch(const char * const arg, CommandLineOptions & options);
+
+/** @brief Reset the search switches that the planner front-end overrides, before any switches are processed. */
+void setCommandLineDefaults();
+
+/** @brief Having performed TIM analysis, set up the state transformer and ground the task.
+ *
+ *  @param options  Options set at the command line, as filled in by <code>processCommandLineSwitch()</code>
+ */
+void initialisePlanner(const CommandLineOptions & options);
+
+/** @brief A single step of a plan, as it would be printed by <code>FFEvent::printPlan</code>. */
+struct PlanStep {
+    /** @brief Time at which the step starts. */
+    double time;
+    /** @brief The ground action, in brackets, e.g. <code>(move r1 wp1 wp2)</code>. */
+    std::string action;
+    /** @brief Duration of the step (epsilon, for non-temporal actions). */
+    double duration;
+    /** @brief The ID of the ground action in the planner's task, or -1 if not known. */
+    int actionID;
+    /** @brief The name of the action's operator, e.g. <code>move</code>. */
+    std::string operatorName;
+    /** @brief The objects the action's parameters are bound to, in order, e.g. <code>{"r1", "wp1", "wp2"}</code>. */
+    std::vector<std::string> parameters;
+
+    PlanStep() : time(0.0), duration(0.0), actionID(-1) {
+    }
+
+    PlanStep(const double & t, const std::string & a, const double & d)
+        : time(t), action(a), duration(d), actionID(-1) {
+    }
+};
+
+/** @brief A request to the planner. */
+struct PlanRequest {
+    /** @brief The text of the PDDL domain. */
+    std::string domain;
+    /** @brief The text of the PDDL problem. */
+    std::string problem;
+    /** @brief Command-line switches, as they would be passed to <code>optic_planner</code>, e.g. <code>{"-N", "-E"}</code>. */
+    std::vector<std::string> arguments;
+    /** @brief Wall-clock time limit in seconds, or a non-positive value for none.
+     *
+     *  This is measured from when the planner starts on the request.  Once it passes, search stops
+     *  (in the middle of heuristic evaluation or an MILP solve, if need be) and returns the best plan found.
+     */
+    double timeLimit;
+
+    PlanRequest() : timeLimit(0.0) {
+    }
+};
+
+/** @brief The result of a call to the planner. */
+struct PlanResult {
+    /** @brief <code>true</code> if a plan was found. */
+    bool solved;
+    /** @brief The steps of the plan, sorted by start time. */
+    std::vector<PlanStep> steps;
+    /** @brief The metric value of the plan. */
+    double quality;
+    /** @brief The number of states evaluated during search. */
+    unsigned int statesEvaluated;
+    /** @brief If no plan was returned, a description of why not. */
+    std::string error;
+
+    PlanResult() : solved(false), quality(0.0), statesEvaluated(0) {
+    }
+};
+
+/** @brief Called with each improved plan found, whilst search carries on looking for better ones.
+ *
+ *  The result passed is marked as solved, and has the plan, its quality, and the number of states
+ *  evaluated so far.
+ */
+typedef std::function<void(const PlanResult &)> PlanCallback;
+
+/** @brief Write a result as a single line of JSON.
+ *
+ *  The object has the members <code>solved</code>, <code>quality</code>, <code>statesEvaluated</code>
+ *  and <code>error</code>, and an array of <code>steps</code>.  Each step has its <code>index</code>
+ *  in the plan, <code>time</code>, <code>duration</code>, <code>actionID</code>, <code>action</code>,
+ *  <code>operator</code> and array of <code>parameters</code>.
+ */
+void writePlanAsJSON(std::ostream & o, const PlanResult & result);
+
+/** @brief Split a string of command-line switches, such as a ROS parameter value, at whitespace. */
+std::vector<std::string> splitArguments(const std::string & arguments);
+
+/** @brief Solve a planning problem in the calling process.
+ *
+ *  The planner keeps its grounded task in process-wide tables, and exits the process on
+ *  critical errors in the input files, so this can only be called once per process.
+ *  Long-lived callers should use <code>solve()</code> instead.
+ *
+ *  If given, <code>onImprovedPlan</code> is called from within search, as each improved plan is found.
+ */
+PlanResult solveInProcess(const PlanRequest & request, const PlanCallback & onImprovedPlan = PlanCallback());
+
+/** @brief Ask <code>solveInProcess()</code>, running on another thread, to stop and return the best plan found so far.
+ *
+ *  This only sets a flag, so it is also safe to call from a signal handler.
+ */
+void cancelSearch();
+
+/** @brief Solve a planning problem in a worker process, running the <code>optic_planner</code> executable.
+ *
+ *  The worker runs <code>solveInProcess()</code> and sends the plan back as binary records
+ *  over a pipe, so there are no temporary files and no re-parsing of plan text.  The worker is
+ *  exec'd as soon as it is forked, so it is safe to call from a multithreaded process; and the
+ *  caller's own state is never touched, so this can be called any number of times from a
+ *  long-lived process.  Improved plans found along the way are sent back as they are found, and
+ *  passed to <code>onImprovedPlan</code>, if given.
+ */
+PlanResult solve(const PlanRequest & request, const PlanCallback & onImprovedPlan = PlanCallback());
+
+/** @brief Serve planning requests on a UNIX socket, until an unrecoverable error occurs.
+ *
+ *  For each domain it is asked about, the server keeps a worker that has parsed and type-checked
+ *  that domain, keyed by a hash of its text, so a request for a domain seen before starts from
+ *  problem parsing.  TIM analyses the domain and problem together, so it runs again for each request.
+ *  The server only reads each request, giving up on a client that stalls part-way through; it then
+ *  passes the client's connection to the domain's worker, which answers it from a process of its
+ *  own, using the same encoding as <code>solveOnServer()</code>.  Requests are thus solved at once,
+ *  each in its own process, rather than in turn.
+ *
+ *  @param socketPath        Where to create the socket.  Any existing file there is removed.
+ *  @param defaultArguments  Switches to use for every request, before those given in the request itself
+ *  @return A non-zero exit status for the process.
+ */
+int serve(const std::string & socketPath, const std::vector<std::string> & defaultArguments);
+
+/** @brief Solve a planning problem using a server started with <code>optic_planner --serve &lt;socket&gt;</code>. */
+PlanResult solveOnServer(const std::string & socketPath, const PlanRequest & request,
+                         const PlanCallback & onImprovedPlan = PlanCallback());
+
+/** @brief An error or warning found when parsing a domain, as the parser would report it. */
+struct ParseDiagnostic {
+    /** @brief <code>true</code> for an error, <code>false</code> for a warning. */
+    bool error;
+    /** @brief The line of the domain it was found on. */
+    int line;
+    /** @brief What was found, e.g. <code>Syntax error in domain</code>. */
+    std::string description;
+
+    ParseDiagnostic() : error(false), line(0) {
+    }
+};
+
+/** @brief The result of checking that a domain parses and type-checks. */
+struct DomainCheckResult {
+    /** @brief <code>true</code> if the domain parsed without errors, and type-checks. */
+    bool valid;
+    /** @brief The parser's errors and warnings, in the order they were found. */
+    std::vector<ParseDiagnostic> diagnostics;
+    /** @brief If the domain parsed but does not type-check, the type checker's log of why not. */
+    std::string typeCheckLog;
+
+    DomainCheckResult() : valid(false) {
+    }
+};
+
+/** @brief Check that a domain parses and type-checks, in the calling process, without grounding or planning.
+ *
+ *  As with <code>solveInProcess()</code>, this leaves the parsed domain in the planner's process-wide
+ *  tables, so it is intended for one-shot callers such as <code>optic_planner --check-only</code>.
+ */
+DomainCheckResult checkDomainInProcess(const std::string & domain);
+
+/** @brief Check that a domain parses and type-checks, in a worker process, as for <code>solve()</code>.
+ *
+ *  Only the lexer, parser and type checker run, so this takes milliseconds, and leaves the
+ *  caller's own state untouched.
+ */
+DomainCheckResult checkDomain(const std::string & domain);
+
+/** @brief Owns the planner's state for a sequence of solves, so a long-lived caller can plan repeatedly.
+ *
+ *  The search's own state is kept in an <code>FF::SearchContext</code> made for each solve, but the
+ *  grounded task, the relaxed planning graph and the parser's state are still process-wide tables in
+ *  the planner, so each context keeps them in the address space of a worker started for each request:
+ *  successive (or concurrent) solves never see each other's state, and a critical error in the input
+ *  files ends only the worker.  Each worker runs the <code>optic_planner</code> executable found
+ *  through the ament index when it is started (or that named by the <code>OPTIC_PLANNER_EXECUTABLE</code>
+ *  environment variable) in its <code>--worker</code> mode, exec'd straight after forking, so nothing
+ *  runs in a copy of a multithreaded caller.  By default, a worker is started ahead of time, so a request can be
+ *  handed over without paying for process start-up on the critical path.
+ *
+ *  <code>solve()</code> may be called concurrently from several threads: each call gets its own worker.
+ */
+class PlannerContext
+{
+
+private:
+
+    /** @brief A worker process, and the parent's ends of the pipes to it. */
+    struct Worker {
+        int pid;
+        int requestFd;
+        int resultFd;
+
+        Worker();
+    };
+
+    /** @brief Switches prepended to the arguments of each request. */
+    std::vector<std::string> defaultArguments;
+
+    /** @brief Whether to keep a spare worker started, ready for the next request. */
+    bool keepWorkerReady;
+
+    /** @brief The spare worker, if any. */
+    Worker readyWorker;
+
+    /** @brief The process IDs of workers currently solving a request. */
+    std::set<int> busyWorkers;
+
+    /** @brief Guards <code>readyWorker</code> and <code>busyWorkers</code>. */
+    std::mutex contextLock;
+
+    static bool startWorker(Worker & worker, std::string & error);
+    static int finishWorker(Worker & worker);
+
+    PlannerContext(const PlannerContext &) = delete;
+    PlannerContext & operator=(const PlannerContext &) = delete;
+
+public:
+
+    /** @param defaultArguments  Switches to use for every request, before those given in the request itself
+     *  @param keepWorkerReady   If <code>true</code>, keep a worker started ready for the next request
+     */
+    PlannerContext(const std::vector<std::string> & defaultArguments = std::vector<std::string>(), const bool keepWorkerReady = true);
+
+    ~PlannerContext();
+
+    /** @brief Solve a planning problem, in its own worker.
+     *
+     *  If given, <code>onImprovedPlan</code> is called on the calling thread as each improved plan
+     *  arrives from the worker, before the final result is returned.
+     */
+    PlanResult solve(const PlanRequest & request, const PlanCallback & onImprovedPlan = PlanCallback());
+
+    /** @brief Ask all solves in progress to stop, each returning the best plan it has found so far. */
+    void cancel();
+};
+
+};
+
+#endif
@@ -26,6 +26,7 @@
  ************************************************************************/
 
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
@@ -52,6 +53,8 @@
 #include "lpscheduler.h"
 #include "numericanalysis.h"
 #include "PreferenceHandler.h"
+#include "opticAPI.h"
+#include "opticWorker.h"
 
 #ifdef STOCHASTICDURATIONS
 #include "StochasticDurations.h"
@@ -88,7 +91,9 @@ void usage(char * argv[])
     cout << "OPTIC: Optimising Preferences and Time-Dependant Costs\n";
     cout << "By releasing this code we imply no warranty as to its reliability\n";
     cout << "and its use is entirely at your own risk.\n\n";
-    cout << "Usage: " << argv[0] << " [OPTIONS] domainfile problemfile [planfile, if -r specified]\n\n";
+    cout << "Usage: " << argv[0] << " [OPTIONS] domainfile problemfile [planfile, if -r specified]\n";
+    cout << "   or: " << argv[0] << " --serve socket [OPTIONS]\n";
+    cout << "   or: " << argv[0] << " --check-only domainfile\n\n";
 
     cout << "Options are: \n\n";
     cout << "\t-N\tDon't optimise solution quality (ignores preferences and costs);\n";
@@ -98,7 +103,9 @@ void usage(char * argv[])
     cout << "\t" << "-b" << "\t\t" << "Disable best-first search - if EHC fails, abort;\n";
     cout << "\t" << "-E" << "\t\t" << "Skip EHC: go straight to best-first search;\n";
     cout << "\t" << "-e" << "\t\t" << "Use standard EHC instead of steepest descent;\n";
+    cout << "\t" << "-U" << "\t\t" << "In best-first search, only evaluate the heuristic of each state when it is expanded;\n";
     cout << "\t" << "-h" << "\t\t" << "Disable helpful-action pruning;\n";
+    cout << "\t" << "-h<boost>" << "\t" << "In best-first search, alternate with a queue of states reached by helpful actions, giving it <boost> extra turns on each improvement;\n";
     cout << "\t" << "-k" << "\t\t" << "Disable compression-safe action detection;\n";
     cout << "\t" << "-c" << "\t\t" << "Enable the tie-breaking in RPG that favour actions that slot into the partial order earlier;\n";
     cout << "\t" << "-S" << "\t\t" << "Sort initial layer facts in RPG by availability order (only use if using -c);\n";
@@ -106,40 +113,143 @@ void usage(char * argv[])
     cout << "\t" << "-F" << "\t\t" << "Full FF helpful actions (rather than just those in the RP applicable in the current state);\n";
     cout << "\t" << "-r" << "\t\t" << "Read in a plan instead of planning;\n";
     cout << "\t" << "-T" << "\t\t" << "Rather than building a partial order, build a total-order\n";
+    cout << "\t" << "-W<w>,<r>[,a]" << "\t" << "Weighted A* with weight <w>, reduced by <r> after each plan; with ,a, carry on from the open and closed lists as the weight is reduced;\n";
+    cout << "\t" << "-u<fd>" << "\t\t" << "Stream each improved plan, as it is found, to file descriptor <fd>, then the final result;\n";
+    cout << "\t" << "-K<switches>" << "\t" << "Add a search configuration to a portfolio run in parallel after preprocessing, e.g. -K\"-W5,1 -h\";\n";
+    cout << "\t" << "-P<file>" << "\t" << "Profile search, writing the calls to and time spent in each phase to <file> as JSON;\n";
+    cout << "\t" << "-J<file>" << "\t" << "Write the plan to <file> as JSON, with the action ID and parameters of each step;\n";
+    cout << "\t" << "-j<file>" << "\t" << "Read the ground actions from <file> if it was saved for this domain and problem, otherwise save them to it;\n";
     cout << "\t" << "-v<n>" << "\t\t" << "Verbose to degree n (n defaults to 1 if not specified).\n";
     cout << "\t" << "-L<n>" << "\t\t" << "LP verbose to degree n (n defaults to 1 if not specified).\n";
 };
 
 list<FFEvent> * readPlan(char* filename);
 
+/** @brief Parse and type-check a domain file, reporting any problems as the planner would, without planning. */
+static int checkDomainFile(const char * const domainFile)
+{
+    std::ifstream domainIn(domainFile);
+    if (!domainIn.is_open()) {
+        cerr << "Failed to open domain file " << domainFile << "\n";
+        return 1;
+    }
+
+    std::ostringstream domainText;
+    domainText << domainIn.rdbuf();
+
+    const DomainCheckResult result = checkDomainInProcess(domainText.str());
+
+    vector<ParseDiagnostic>::const_iterator diagItr = result.diagnostics.begin();
+    const vector<ParseDiagnostic>::const_iterator diagEnd = result.diagnostics.end();
+
+    for (; diagItr != diagEnd; ++diagItr) {
+        cout << domainFile << ": line: " << diagItr->line << ": " << (diagItr->error ? "Error: " : "Warning: ")
+             << diagItr->description << "\n";
+    }
+
+    if (!result.typeCheckLog.empty()) {
+        cout << "Type Errors Encountered in Domain File\n";
+        cout << result.typeCheckLog;
+    }
+
+    return (result.valid ? 0 : 1);
+}
+
+/** @brief Print the steps of a plan found by a portfolio, as <code>FFEvent::printPlan</code> would. */
+static void printPortfolioPlan(std::ostream & o, const PlanResult & result)
+{
+    o << std::setprecision(3) << std::fixed;
+
+    vector<PlanStep>::const_iterator stepItr = result.steps.begin();
+    const vector<PlanStep>::const_iterator stepEnd = result.steps.end();
+
+    for (; stepItr != stepEnd; ++stepItr) {
+        o << stepItr->time << ": " << stepItr->action << "  [" << stepItr->duration << "]\n";
+    }
+}
+
+/** @brief Print a plan found by search, and write it to the output file. */
+static void printSolution(const list<FFEvent> & plan, const CommandLineOptions & options)
+{
+    FFEvent::printPlan(plan);
+    std::ofstream outFile(options.outputFilePath);
+    if (outFile.is_open()) {
+        outFile << "; Solution Found ";
+        FFEvent::printPlan(plan, outFile);
+        outFile.close();
+    } else {
+        std::cerr << "Error during output file opening phase!" << std::endl;
+    }
+}
+
+/** @brief Search under each of the <code>-K</code> configurations at once, and print the plan that wins. */
+static int runPortfolio(const CommandLineOptions & options)
+{
+    PlanCallback onImprovedPlan;
+    if (options.planStreamFd >= 0) {
+        onImprovedPlan = [&options](const PlanResult & improved) {
+            WorkerChannel stream(options.planStreamFd);
+            stream.writeFrame(WorkerChannel::E_IMPROVED_PLAN_FRAME, improved);
+        };
+    }
+
+    PlanResult result;
+    searchPortfolio(options, result, onImprovedPlan);
+
+    writeStructuredPlan(result, options);
+
+    if (!result.solved) {
+        cout << ";; Problem unsolvable!\n";
+        if (!result.error.empty()) {
+            cout << "; " << result.error << "\n";
+        }
+        return 1;
+    }
+
+    cout << ";;;; Solution Found\n";
+    cout << "; States evaluated: " << result.statesEvaluated << endl;
+    cout << "; Cost: " << result.quality << endl;
+    printPortfolioPlan(cout, result);
+
+    std::ofstream outFile(options.outputFilePath);
+    if (outFile.is_open()) {
+        outFile << "; Solution Found\n";
+        printPortfolioPlan(outFile, result);
+        outFile.close();
+    } else {
+        std::cerr << "Error during output file opening phase!" << std::endl;
+    }
+
+    return 0;
+}
+
 
 
 int main(int argc, char * argv[])
 {
 
-    FAverbose = false;
+    if (argc >= 3 && string(argv[1]) == "--serve") {
+        return serve(argv[2], vector<string>(&argv[3], &argv[argc]));
+    }
 
-    int argcount = 1;
+    if (argc == 4 && string(argv[1]) == "--worker") {
+        return runWorker(atoi(argv[2]), atoi(argv[3]));
+    }
+
+    if (argc == 4 && string(argv[1]) == "--check-worker") {
+        return runDomainCheckWorker(atoi(argv[2]), atoi(argv[3]));
+    }
 
-    FF::steepestDescent = false;
-    FF::incrementalExpansion = false;
-    FF::invariantRPG = false;
-    FF::timeWAStar = false;
-    LPScheduler::hybridBFLP = false;
+    if (argc == 3 && string(argv[1]) == "--check-only") {
+        return checkDomainFile(argv[2]);
+    }
 
-    bool benchmark = false;
-    bool readInAPlan = false;
-    bool postHocTotalOrder = false;
-    bool debugPreprocessing = false;
-    bool postHocScheduleToMetric = false;
+    setCommandLineDefaults();
 
-    #ifdef STOCHASTICDURATIONS
-    const char * const defaultDurationManager = "montecarlo";
+    int argcount = 1;
 
-    const char * durationManagerString = defaultDurationManager;
-    #endif
+    CommandLineOptions options;
 
-    std::string output_file_path = "/tmp/plan.pddl";
     while (argcount < argc) {
 
         string remainder(&(argv[argcount][1]));
@@ -189,307 +299,17 @@ int main(int argc, char * argv[])
                 ++argcount;
                 continue;
             }
-            switch (argv[argcount][1]) {
-            #ifdef POPF3ANALYSIS
-            case 'l': {
-                NumericAnalysis::doGoalLimitAnalysis = false;
-                break;
-            }
-            #endif
-            case ']': {
-                RPGHeuristic::alwaysExpandFully = true;
+            switch (processCommandLineSwitch(argv[argcount], options)) {
+            case E_SWITCH_OK: {
                 break;
             }
-            case '[': {
-                RPGHeuristic::addTheMaxCosts = true;
-                cout << "Warning: assuming max costs are additive-max safe\n";
-                break;
-            }
-            case '2': {
-                RPGBuilder::noSelfOverlaps = true;
-                break;
-            }
-            case 'D': {
-                Globals::paranoidScheduling = true;
-                break;
-            }
-            case 'd': {
-                FF::nonDeletorsFirst = true;
-                break;
-            }
-            case 'P': {
-                Globals::profileScheduling = true;
-                break;
-            }
-            case 'A': {
-                RPGHeuristic::estimateCosts = false;
-                break;
-            }
-            case 'a': {
-                FF::costOptimalAStar = true;
-                break;
-            }
-            case 'g': {
-                RPGHeuristic::setGuidance(&(argv[argcount][2]));
-                break;
-            }
-            case '/': {
-                LPScheduler::workOutFactLayerZeroBoundsStraightAfterRecentAction = true;
-                break;
-            }
-            case 'G': {
-                FF::biasG = true;
-                break;
-            }
-            case '8': {
-                FF::biasD = true;
-                break;
-            }
-            case 'S': {
-                RPGBuilder::sortedExpansion = true;
-                break;
-            }
-            case '3': {
-                FF::relaxMIP = true;
-                break;
-            }
-            case 'F': {
-                RPGBuilder::fullFFHelpfulActions = true;
-                break;
-            }
-            #ifdef STOCHASTICDURATIONS
-            case 'f': {
-                solutionDeadlineTime = atof(&(argv[argcount][2]));
-                break;
-            }
-            case 'M': {
-                durationManagerString = &(argv[argcount][2]);
-                break;
-            }
-            #else
-            case 'M': {
-                FF::makespanTieBreak = false;
-                break;
-            }
-            #endif
-            case 'b': {
-                FF::bestFirstSearch = false;
-                break;
-            }
-            case 'B': {
-                benchmark = true;
-                break;
-            }
-            case 'e': {
-                FF::steepestDescent = true;
-                break;
-            }
-            case 'E': {
-                FF::skipEHC = true;
-                break;
-            }
-            case 'k': {
-                RPGBuilder::doSkipAnalysis = false;
-                break;
-            }
-            case 'm': {
-                if (argv[argcount][2] == '2') {
-                    FF::openListOrderLowCostFirst = true;
-                } else {
-                    FF::openListOrderLowMakespanFirst = true;
-                }
-                break;
-            }
-            case 'c': {
-                RPGBuilder::modifiedRPG = false;
-                break;
-            }
-            case 'C': {
-                FF::allowCompressionSafeScheduler = true;
-                break;
-            }
-            #ifdef ENABLE_DEBUGGING_HOOKS
-            case 'H': {
-                debugPreprocessing = true;
-                break;
-            }
-            #endif
-            case 'h': {
-                FF::helpfulActions = false;
-                break;
-            }
-            case 'i': {
-                FF::firstImprover = true;
-                break;
-            }
-            case 'O': {
-                FF::startsBeforeEnds = false;
-                break;
-            }
-            case 'o': {
-                LPScheduler::optimiseOrdering = false;
-                break;
-            }
-            case 'p': {
-                FF::pruneMemoised = false;
-                break;
-            }
-            case 'R': {
-                FF::invariantRPG = true;
-                break;
-            }
-            case 'q': {
-                FF::useDominanceConstraintsInStateHash = true;
-                break;
-            }
-            case 'x': {
-                if (argv[argcount][2] == 0) {
-                    cerr << "Error: must specify a time limit after -x, e.g. -x1800\n";
-                    usage(argv);
-                    exit(1);
-                }
-                cout << "Time limit: " << atoi(&(argv[argcount][2])) * 0.8 << endl;
-                Globals::timeLimit = atoi(&(argv[argcount][2])) * 0.8;
-                break;
-            }
-            case 'T': {
-                Globals::totalOrder = true;
-                RPGBuilder::modifiedRPG = false;
-                FF::tsChecking = true;
-                if (argv[argcount][2] == 'T') {
-                    postHocTotalOrder = true;
-                }
-                break;
-            }
-            case 't': {
-                FF::tsChecking = false;
-                break;
-            }
-            case 'X': {
-                NumericAnalysis::readBounds = true;
-                break;
-            }
-            case 'Q': {
-                postHocScheduleToMetric = true;
-                break;
-            }
-            case 'v': {
-                if (argv[argcount][2] == 'p') {
-                    PreferenceHandler::preferenceDebug = true;
-                } else if (argv[argcount][2] != 0) {
-                    Globals::writeableVerbosity = atoi(&(argv[argcount][2]));
-                } else {
-                    cout << "No verbosity level specified with -v, defaulting to 1\n";
-                    Globals::writeableVerbosity = 1;
-                }
-                break;
-            }
-            case 'L': {
-                if (argv[argcount][2] != 0) {
-                    LPScheduler::lpDebug = atoi(&(argv[argcount][2]));
-                } else {
-                    LPScheduler::lpDebug = 255;
-                }
-                break;
-            }
-            case 'W': {
-                string Warg(&(argv[argcount][2]));
-                if (Warg.empty()) {
-                    cerr << "Error: must specify weight after W, e.g. -W5, or specify a weight and restart weight reduction, e.g. -W5,1\n";
-                    usage(argv);
-                    exit(1);
-                }
-                const int commaAt = Warg.find(',');
-                if (commaAt == string::npos) {
-                    istringstream conv(Warg);
-                    if (!(conv >> FF::doubleU)) {
-                        cerr << "Error: must specify weight after W, e.g. -W5, or specify a weight and restart weight reduction, e.g. -W5,1\n";
-                        usage(argv);
-                        exit(1);
-                    }
-                } else {
-                    const string W = Warg.substr(0,commaAt);
-                    {
-                        istringstream conv(W);
-                        if (!(conv >> FF::doubleU)) {
-                            cerr << "Error: must specify weight after W, e.g. -W5, or specify a weight and restart weight reduction, e.g. -W5,1\n";
-                            usage(argv);
-                            exit(1);
-                        }
-                    }
-                    const string WR = Warg.substr(commaAt + 1);
-                    {
-                        istringstream conv(WR);
-                        if (!(conv >> FF::doubleUReduction)) {
-                            cerr << "Error: must specify weight after W, e.g. -W5, or specify a weight and restart weight reduction, e.g. -W5,1\n";
-                            usage(argv);
-                            exit(1);
-                        }
-                    }
-                }
-                break;
-            }
-            case 'w': {
-                RPGHeuristic::orderByDeadlineRelevance = true;
-                break;
-            }
-            case 'I': {
-                LPScheduler::hybridBFLP = false;
-                break;
-            }
-            case 'y': {
-                output_file_path = &(argv[argcount][2]);
-                break;
-            }
-            case 'r': {
-                readInAPlan = true;
-                #ifdef POPF3ANALYSIS
-                if (argv[argcount][2] != 0) {
-                    FF::reprocessQualityBound = atof(&(argv[argcount][2]));
-                }
-                #endif
-                break;
-            }
-            case '0': {
-                TemporalAnalysis::abstractTILsWherePossible = true;
-                LPScheduler::hybridBFLP = false;
-                break;
-            }
-            case 's': {
-                FF::planMustSucceed = true;
-                break;
-            }
-            case 'z': {
-                FF::zealousEHC = false;
-                break;
-            }
-            case 'Z': {
-                RPGHeuristic::printRPGAsDot = true;
-                break;
-            }
-            #ifdef POPF3ANALYSIS
-            case 'n': {
-                Globals::optimiseSolutionQuality = true;
-                if (argv[argcount][2] != 0) {
-                    Globals::givenSolutionQualityDefined = true;
-                    Globals::givenSolutionQuality = atof(&(argv[argcount][2]));
-                }
-                break;
-            }
-            case 'N': {
-                Globals::optimiseSolutionQuality = false;
-                break;
-            }
-            case '>': {
-                Globals::improvementBetweenSolutions = atof(&(argv[argcount][2]));
-                break;
+            case E_SWITCH_BAD_ARGUMENT: {
+                usage(argv);
+                exit(1);
             }
-            #endif
             default:
-                cout << "Unrecognised command-line switch '" << argv[argcount][1] << "'\n";
                 usage(argv);
                 exit(0);
-
             }
 
         }
@@ -513,57 +333,36 @@ int main(int argc, char * argv[])
     #endif
 
     int domain_arg_number = 1;
+
+    if (!Globals::groundingSnapshot.empty()) {
+        for (int f = 0; f < 2; ++f) {
+            ifstream in(argv[domain_arg_number + f]);
+            ostringstream text;
+            text << in.rdbuf();
+            const string & textString = text.str();
+            Globals::addToTaskFingerprint(textString.data(), textString.size());
+        }
+    }
+
     performTIMAnalysis(&argv[domain_arg_number]);
 
     cout << std::setprecision(3) << std::fixed;
-    cout << "File path" << output_file_path << "\n";
-    #ifdef STOCHASTICDURATIONS
-    setDurationManager(durationManagerString);
-    #endif
-
-    #ifdef TOTALORDERSTATES
-    MinimalState::setTransformer(new TotalOrderTransformer());
-    #else
-    if (Globals::totalOrder) {
-        MinimalState::setTransformer(new TotalOrderTransformer());
-    } else {
-        MinimalState::setTransformer(new PartialOrderTransformer());
-    }
-    #endif
+    cout << "File path" << options.outputFilePath << "\n";
 
     #ifdef ENABLE_DEBUGGING_HOOKS
-    if (debugPreprocessing) {
+    if (options.debugPreprocessing) {
         Globals::planFilename = argv[argc - 1];
     }
     #endif
 
-    #ifdef POPF3ANALYSIS
-    const bool realOpt = Globals::optimiseSolutionQuality;
-    Globals::optimiseSolutionQuality = (Globals::optimiseSolutionQuality || postHocScheduleToMetric);
-    #endif
-
-    RPGBuilder::initialise();
-
-    #ifdef POPF3ANALYSIS
-    Globals::optimiseSolutionQuality = realOpt;
-    #endif
+    initialisePlanner(options);
 
-    #ifdef STOCHASTICDURATIONS
-    initialiseDistributions();
-    setSolutionDeadlineTimeToLatestGoal();
-    #endif
-
-    if (Globals::optimiseSolutionQuality && Globals::givenSolutionQualityDefined) {
-        if (RPGBuilder::getMetric()) {
-            cout << "Forcing the use of the given solution quality of " << Globals::givenSolutionQuality << endl;
-            if (RPGBuilder::getMetric()->minimise) {
-                Globals::bestSolutionQuality = (Globals::givenSolutionQuality == 0.0 ? 0.0 : -Globals::givenSolutionQuality);
-            } else {
-                Globals::bestSolutionQuality = Globals::givenSolutionQuality;
-            }
+    if (!options.portfolio.empty() && !options.readInAPlan) {
+        return runPortfolio(options);
+    }
 
-            RPGBuilder::getHeuristic()->metricHasChanged();
-        }
+    if (options.planStreamFd >= 0) {
+        streamImprovedPlans(options.planStreamFd);
     }
 
 
@@ -572,8 +371,8 @@ int main(int argc, char * argv[])
     Solution planAndConstraints;
 
     list<FFEvent> * & spSoln = planAndConstraints.plan;
-    cout << "RED IN A PLAN"<< readInAPlan;
-    if (readInAPlan) {
+    cout << "RED IN A PLAN"<< options.readInAPlan;
+    if (options.readInAPlan) {
         cout  << argc - 1 << " " << argv[argc - 1] << endl;
         spSoln = readPlan(argv[argc - 1]);
         reachesGoals = true;
@@ -586,44 +385,31 @@ int main(int argc, char * argv[])
 
     if (spSoln) {
 
-        for (int pass = 0; pass < 2; ++pass) {
-            if (pass) {
-                if (!postHocScheduleToMetric) break;
-                #ifndef TOTALORDERSTATES
-                if (!spSoln->empty()) {
-                    if (Globals::totalOrder && !postHocTotalOrder) {
-                        MinimalState::setTransformer(new PartialOrderTransformer());
-                        Globals::totalOrder = false;
-                        FF::tsChecking = false;
-                    }
-                    assert(planAndConstraints.constraints);
-                    spSoln = FF::reprocessPlan(spSoln, planAndConstraints.constraints);
-                    planAndConstraints.constraints = 0;
-                }
+        cout << ";;;; Solution Found\n";
+        cout << "; States evaluated: " << RPGHeuristic::statesEvaluated << endl;
+        cout << "; Cost: " << planAndConstraints.quality << endl;
+        printSolution(*spSoln, options);
+
+        if (options.postHocScheduleToMetric) {
+            const list<FFEvent> * const asFound = spSoln;
+            scheduleSolutionToMetric(planAndConstraints, options);
+            if (spSoln != asFound) {
                 cout << ";;;; Post-hoc optimised solution\n";
-                #endif
-            } else {
-                cout << ";;;; Solution Found\n";
-                cout << "; States evaluated: " << RPGHeuristic::statesEvaluated << endl;
                 cout << "; Cost: " << planAndConstraints.quality << endl;
+                printSolution(*spSoln, options);
             }
-            FFEvent::printPlan(*spSoln);
-            std::ofstream outFile(output_file_path);
-            if (outFile.is_open()) {
-                outFile << "; Solution Found ";
-                FFEvent::printPlan(*spSoln, outFile);
-                outFile.close();
-            } else {
-                std::cerr << "Error during output file opening phase!" << std::endl;
-            }               
         }
 
-        if (benchmark) {
+        writeStructuredPlan(planAndConstraints, options);
+
+        if (options.benchmark) {
             FF::doBenchmark(reachesGoals, spSoln);
         }
 
         return 0;
     } else {
+        writeStructuredPlan(planAndConstraints, options);
+
         cout << ";; Problem unsolvable!\n";
         tms refReturn;
         times(&refReturn);
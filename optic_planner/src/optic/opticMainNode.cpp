@@ -123,7 +123,7 @@ public:
         bool postHocScheduleToMetric = false;
         if(timeout_ > 0)
         {
-            Globals::timeLimit = timeout_;
+            Globals::setTimeLimit(timeout_);
         }
         /*
         #ifdef STOCHASTICDURATIONS
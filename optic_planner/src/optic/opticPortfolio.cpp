@@ -0,0 +1,327 @@
+/************************************************************************
+ * This file is part of OPTIC.
+ *
+ * OPTIC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * OPTIC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OPTIC.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ************************************************************************/
+
+#include "opticAPI.h"
+#include "opticWorker.h"
+
+#include "RPGBuilder.h"
+#include "FFSolver.h"
+#include "globals.h"
+#include "searchprofile.h"
+#include "totalordertransformer.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+namespace Planner
+{
+
+/** @brief How often the portfolio checks for its own time limit or cancellation, in milliseconds. */
+static const int portfolioPollInterval = 100;
+
+/** @brief Where a configuration's process sends the plans it finds. */
+static WorkerChannel * portfolioChannel = 0;
+
+/** @brief Registered as <code>FF::newBestSolution</code> in each configuration's process. */
+static void sendImprovedPlan(const Solution & solution)
+{
+    PlanResult improved;
+    describeSolution(solution, improved);
+    portfolioChannel->writeFrame(WorkerChannel::E_IMPROVED_PLAN_FRAME, improved);
+}
+
+static void cancelConfigurationOnSignal(int)
+{
+    Globals::cancelSearch();
+}
+
+/** @brief The body of a configuration's process: apply its switches, search, and send back the plan found. */
+static void runConfiguration(const string & configuration, const CommandLineOptions & sharedOptions, const int & resultFd)
+{
+    struct sigaction cancelAction;
+    memset(&cancelAction, 0, sizeof(cancelAction));
+    cancelAction.sa_handler = cancelConfigurationOnSignal;
+    sigemptyset(&cancelAction.sa_mask);
+    sigaction(SIGUSR1, &cancelAction, 0);
+
+    sigset_t cancelSignal;
+    sigemptyset(&cancelSignal);
+    sigaddset(&cancelSignal, SIGUSR1);
+    sigprocmask(SIG_UNBLOCK, &cancelSignal, 0);
+
+    // the configurations' search traces would only interleave
+    const int devNull = open("/dev/null", O_WRONLY);
+    if (devNull >= 0) {
+        dup2(devNull, STDOUT_FILENO);
+        close(devNull);
+    }
+
+    WorkerChannel out(resultFd);
+
+    CommandLineOptions options(sharedOptions);
+    const bool wasTotalOrder = Globals::totalOrder;
+
+    const vector<string> switches = splitArguments(configuration);
+    const vector<string>::const_iterator sEnd = switches.end();
+    for (vector<string>::const_iterator sItr = switches.begin(); sItr != sEnd; ++sItr) {
+        if (sItr->size() < 2 || (*sItr)[0] != '-' || processCommandLineSwitch(sItr->c_str(), options) != E_SWITCH_OK) {
+            PlanResult invalid;
+            invalid.error = "Invalid switch '" + *sItr + "' in portfolio configuration '" + configuration + "'";
+            out.writeFrame(WorkerChannel::E_RESULT_FRAME, invalid);
+            return;
+        }
+    }
+
+    #ifndef TOTALORDERSTATES
+    if (Globals::totalOrder && !wasTotalOrder) {
+        MinimalState::setTransformer(new TotalOrderTransformer());
+    }
+    #endif
+
+    portfolioChannel = &out;
+    FF::newBestSolution = sendImprovedPlan;
+
+    bool reachesGoals;
+    Solution planAndConstraints = FF::search(reachesGoals);
+
+    FF::newBestSolution = 0;
+
+    PlanResult result;
+    if (planAndConstraints.plan) {
+        scheduleSolutionToMetric(planAndConstraints, options);
+        describeSolution(planAndConstraints, result);
+    } else {
+        result.statesEvaluated = RPGHeuristic::statesEvaluated;
+        result.error = "Problem unsolvable";
+    }
+
+    out.writeFrame(WorkerChannel::E_RESULT_FRAME, result);
+}
+
+/** @brief Whether <code>a</code> is a better plan than <code>b</code>, for the task's metric (or makespan, if it has none). */
+static bool betterPlan(const PlanResult & a, const PlanResult & b)
+{
+    if (!a.solved) return false;
+    if (!b.solved) return true;
+
+    const RPGBuilder::Metric * const theMetric = RPGBuilder::getMetric();
+
+    if (theMetric && !theMetric->minimise) {
+        return (a.quality > b.quality);
+    }
+    return (a.quality < b.quality);
+}
+
+/** @brief A configuration's process, and the read end of the pipe it sends its plans down. */
+struct Configuration {
+    pid_t pid;
+    int resultFd;
+
+    Configuration() : pid(-1), resultFd(-1) {
+    }
+};
+
+void searchPortfolio(const CommandLineOptions & options, PlanResult & result, const PlanCallback & onImprovedPlan)
+{
+    const int configurationCount = options.portfolio.size();
+    vector<Configuration> configurations(configurationCount);
+
+    cout.flush();
+    cerr.flush();
+
+    // keep the cancellation signal pending until each configuration has its handler in place
+    sigset_t cancelSignal;
+    sigset_t previousMask;
+    sigemptyset(&cancelSignal);
+    sigaddset(&cancelSignal, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &cancelSignal, &previousMask);
+
+    for (int c = 0; c < configurationCount; ++c) {
+        int resultFds[2];
+        if (pipe(resultFds) != 0) {
+            cerr << "Could not start portfolio configuration '" << options.portfolio[c] << "': " << strerror(errno) << endl;
+            continue;
+        }
+
+        const pid_t pid = fork();
+
+        if (pid < 0) {
+            cerr << "Could not start portfolio configuration '" << options.portfolio[c] << "': " << strerror(errno) << endl;
+            close(resultFds[0]);
+            close(resultFds[1]);
+            continue;
+        }
+
+        if (pid == 0) {
+            for (int p = 0; p < c; ++p) {
+                if (configurations[p].resultFd >= 0) {
+                    close(configurations[p].resultFd);
+                }
+            }
+            close(resultFds[0]);
+
+            SearchProfile::suffixOutputFile(std::to_string(c));
+
+            runConfiguration(options.portfolio[c], options, resultFds[1]);
+
+            cout.flush();
+            _exit(EXIT_SUCCESS);
+        }
+
+        close(resultFds[1]);
+        configurations[c].pid = pid;
+        configurations[c].resultFd = resultFds[0];
+    }
+
+    sigprocmask(SIG_SETMASK, &previousMask, 0);
+
+    PlanResult best;
+
+    /* The last plan each configuration sent.  Its final plan replaces those it sent before, even if no better:
+     * with -Q, that plan has been rescheduled since. */
+    vector<PlanResult> latest(configurationCount);
+
+    // if quality is not being optimised, the first configuration to find a plan, once the others are stopped
+    int winner = -1;
+    bool cancellationPassedOn = false;
+
+    while (true) {
+        vector<pollfd> waitingOn;
+        vector<int> waitingFor;
+
+        for (int c = 0; c < configurationCount; ++c) {
+            if (configurations[c].resultFd >= 0) {
+                pollfd toAdd;
+                toAdd.fd = configurations[c].resultFd;
+                toAdd.events = POLLIN;
+                toAdd.revents = 0;
+                waitingOn.push_back(toAdd);
+                waitingFor.push_back(c);
+            }
+        }
+
+        if (waitingOn.empty()) {
+            break;
+        }
+
+        if (!cancellationPassedOn && Globals::searchWasCancelled()) {
+            // the configurations enforce the time limit themselves, but cancellation has to be passed on
+            for (int c = 0; c < configurationCount; ++c) {
+                if (configurations[c].resultFd >= 0) {
+                    kill(configurations[c].pid, SIGUSR1);
+                }
+            }
+            cancellationPassedOn = true;
+        }
+
+        if (poll(&(waitingOn[0]), waitingOn.size(), portfolioPollInterval) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        const int waitingCount = waitingOn.size();
+        for (int w = 0; w < waitingCount; ++w) {
+            if (!waitingOn[w].revents) continue;
+
+            const int c = waitingFor[w];
+            WorkerChannel in(configurations[c].resultFd);
+
+            unsigned char type = WorkerChannel::E_RESULT_FRAME;
+            PlanResult received;
+
+            if (!in.readFrame(type, received) || type == WorkerChannel::E_RESULT_FRAME) {
+                close(configurations[c].resultFd);
+                configurations[c].resultFd = -1;
+            }
+
+            if (!received.solved) {
+                if (!best.solved && best.error.empty()) {
+                    best.error = received.error;
+                }
+                continue;
+            }
+
+            if (winner >= 0) {
+                if (c == winner) {
+                    // its final plan, once rescheduled if need be
+                    best = received;
+                }
+                continue;
+            }
+
+            const bool improved = betterPlan(received, best);
+
+            latest[c] = received;
+
+            int bestFrom = -1;
+            for (int other = 0; other < configurationCount; ++other) {
+                if (latest[other].solved && (bestFrom < 0 || betterPlan(latest[other], latest[bestFrom]))) {
+                    bestFrom = other;
+                }
+            }
+            best = latest[bestFrom];
+
+            if (!improved) {
+                continue;
+            }
+
+            if (onImprovedPlan && type == WorkerChannel::E_IMPROVED_PLAN_FRAME) {
+                onImprovedPlan(best);
+            }
+
+            if (!Globals::optimiseSolutionQuality) {
+                winner = c;
+                for (int other = 0; other < configurationCount; ++other) {
+                    if (other != winner && configurations[other].resultFd >= 0) {
+                        kill(configurations[other].pid, SIGKILL);
+                    }
+                }
+            }
+        }
+    }
+
+    for (int c = 0; c < configurationCount; ++c) {
+        if (configurations[c].pid > 0) {
+            while (waitpid(configurations[c].pid, 0, 0) < 0 && errno == EINTR) {
+            }
+        }
+    }
+
+    result = best;
+    if (!result.solved && result.error.empty()) {
+        result.error = "No portfolio configuration returned a result";
+    }
+}
+
+};
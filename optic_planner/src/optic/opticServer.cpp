@@ -0,0 +1,422 @@
+/************************************************************************
+ * This file is part of OPTIC.
+ *
+ * OPTIC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * OPTIC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OPTIC.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ************************************************************************/
+
+#include "opticAPI.h"
+#include "opticWorker.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <utility>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::map;
+using std::string;
+using std::vector;
+
+namespace Planner
+{
+
+/** @brief The most domains for which the server keeps a worker with the domain parsed. */
+static const unsigned int cachedDomainLimit = 8;
+
+/** @brief How long the server waits on a client that has connected but not yet sent all of its request, in seconds. */
+static const int clientReadTimeout = 10;
+
+/** @brief A process that has parsed a domain, and plans for problems in it. */
+struct DomainWorker {
+    /** @brief The text of the domain, to rule out hash collisions. */
+    string domain;
+    int pid;
+    /** @brief A socket to the worker, over which each request is passed along with the client's connection. */
+    int fd;
+    /** @brief When the worker was last used, in requests served, for evicting the least recently used. */
+    unsigned long lastUsed;
+
+    DomainWorker() : pid(-1), fd(-1), lastUsed(0) {
+    }
+};
+
+/** @brief Parsed domains, by hash of their text. */
+typedef map<size_t, DomainWorker> DomainWorkers;
+
+/** @brief Pass a request to a domain worker, along with the client's connection, so the worker can answer the client directly. */
+static bool passRequest(const int & workerFd, const PlanRequest & request, const int & clientFd)
+{
+    char marker = 0;
+    iovec data;
+    data.iov_base = &marker;
+    data.iov_len = 1;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr * const header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &clientFd, sizeof(int));
+
+    ssize_t sent;
+    while ((sent = sendmsg(workerFd, &message, 0)) < 0 && errno == EINTR) {
+    }
+    if (sent != 1) {
+        return false;
+    }
+
+    WorkerChannel worker(workerFd);
+    return worker.write(request);
+}
+
+/** @brief Receive a request passed by <code>passRequest()</code>, and the client's connection to answer it on. */
+static bool receiveRequest(const int & fd, PlanRequest & request, int & clientFd)
+{
+    char marker;
+    iovec data;
+    data.iov_base = &marker;
+    data.iov_len = 1;
+
+    char control[CMSG_SPACE(sizeof(int))];
+
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t got;
+    while ((got = recvmsg(fd, &message, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {
+    }
+    if (got != 1) {
+        return false;
+    }
+
+    const cmsghdr * const header = CMSG_FIRSTHDR(&message);
+    if (!header || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+        return false;
+    }
+    memcpy(&clientFd, CMSG_DATA(header), sizeof(int));
+
+    WorkerChannel server(fd);
+    if (!server.read(request)) {
+        close(clientFd);
+        return false;
+    }
+    return true;
+}
+
+/** @brief The body of a domain worker: parse and type-check the domain, then plan for each problem passed to it.
+ *
+ *  Each request is answered by a process forked from this one, so starts with the domain already
+ *  parsed and type-checked, and writes its plans straight to the client.  Meanwhile, this process
+ *  goes back to waiting for the next request, so one long search does not hold up the others.
+ */
+static void runDomainWorker(const string & domain, const int & fd)
+{
+    parseDomainInAdvance(domain);
+
+    PlanRequest request;
+    int clientFd;
+
+    while (receiveRequest(fd, request, clientFd)) {
+        // reap those that have answered their requests since the last
+        while (waitpid(-1, 0, WNOHANG) > 0) {
+        }
+
+        cout.flush();
+        cerr.flush();
+
+        const pid_t pid = fork();
+
+        if (pid == 0) {
+            close(fd);
+
+            WorkerChannel client(clientFd);
+
+            const PlanResult result = solveInForkedWorker(request, [&client](const PlanResult & improved) {
+                client.writeFrame(WorkerChannel::E_IMPROVED_PLAN_FRAME, improved);
+            });
+
+            client.writeFrame(WorkerChannel::E_RESULT_FRAME, result);
+            _exit(EXIT_SUCCESS);
+        }
+
+        if (pid < 0) {
+            PlanResult failed;
+            failed.error = string("Could not start the planner: ") + strerror(errno);
+
+            WorkerChannel client(clientFd);
+            client.writeFrame(WorkerChannel::E_RESULT_FRAME, failed);
+        }
+
+        close(clientFd);
+    }
+}
+
+static void finishDomainWorker(DomainWorker & worker)
+{
+    // closing its socket tells the worker to exit: any requests it has in hand are still answered
+    close(worker.fd);
+    while (waitpid(worker.pid, 0, 0) < 0 && errno == EINTR) {
+    }
+}
+
+static bool startDomainWorker(DomainWorker & worker, const int & listenFd, const int & clientFd, const DomainWorkers & others)
+{
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        return false;
+    }
+
+    cout.flush();
+    cerr.flush();
+
+    const pid_t pid = fork();
+
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        close(listenFd);
+        close(clientFd);
+        DomainWorkers::const_iterator oItr = others.begin();
+        const DomainWorkers::const_iterator oEnd = others.end();
+        for (; oItr != oEnd; ++oItr) {
+            close(oItr->second.fd);
+        }
+        close(fds[0]);
+
+        runDomainWorker(worker.domain, fds[1]);
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+
+    worker.pid = pid;
+    worker.fd = fds[0];
+
+    return true;
+}
+
+/** @brief Evict the least recently used domain worker. */
+static void evictDomainWorker(DomainWorkers & workers)
+{
+    DomainWorkers::iterator oldest = workers.begin();
+    DomainWorkers::iterator wItr = workers.begin();
+    const DomainWorkers::iterator wEnd = workers.end();
+
+    for (; wItr != wEnd; ++wItr) {
+        if (wItr->second.lastUsed < oldest->second.lastUsed) {
+            oldest = wItr;
+        }
+    }
+
+    finishDomainWorker(oldest->second);
+    workers.erase(oldest);
+}
+
+/** @brief Hand a request received by the server to the worker for its domain, starting one if need be.
+ *
+ *  The worker answers the client itself, so this returns as soon as the request has been passed on.
+ *
+ *  @return An error to send the client, if the request could not be passed on; otherwise, the empty string.
+ */
+static string serveRequest(const PlanRequest & request, DomainWorkers & workers, const int & listenFd, const int & clientFd,
+                           const unsigned long & requestCount)
+{
+    const size_t domainHash = std::hash<string>()(request.domain);
+
+    // if the worker has gone since it was last used, try again with a fresh one
+    for (int attempt = 0; attempt < 2; ++attempt) {
+
+        DomainWorkers::iterator wItr = workers.find(domainHash);
+
+        if (wItr != workers.end() && wItr->second.domain != request.domain) {
+            finishDomainWorker(wItr->second);
+            workers.erase(wItr);
+            wItr = workers.end();
+        }
+
+        if (wItr == workers.end()) {
+            if (workers.size() >= cachedDomainLimit) {
+                evictDomainWorker(workers);
+            }
+
+            DomainWorker worker;
+            worker.domain = request.domain;
+
+            if (!startDomainWorker(worker, listenFd, clientFd, workers)) {
+                return string("Could not start the planner: ") + strerror(errno);
+            }
+
+            wItr = workers.insert(std::make_pair(domainHash, worker)).first;
+        }
+
+        wItr->second.lastUsed = requestCount;
+
+        if (passRequest(wItr->second.fd, request, clientFd)) {
+            return string();
+        }
+
+        finishDomainWorker(wItr->second);
+        workers.erase(wItr);
+    }
+
+    return "The planner terminated without returning a result";
+}
+
+static bool makeSocketAddress(const string & socketPath, sockaddr_un & address)
+{
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    return true;
+}
+
+int serve(const string & socketPath, const vector<string> & defaultArguments)
+{
+    sockaddr_un address;
+    if (!makeSocketAddress(socketPath, address)) {
+        cerr << "Socket path " << socketPath << " is too long\n";
+        return 1;
+    }
+
+    // a client hanging up must not take the server with it
+    signal(SIGPIPE, SIG_IGN);
+
+    const int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        cerr << "Could not create socket: " << strerror(errno) << endl;
+        return 1;
+    }
+
+    unlink(socketPath.c_str());
+
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listenFd, 16) != 0) {
+        cerr << "Could not listen on " << socketPath << ": " << strerror(errno) << endl;
+        close(listenFd);
+        return 1;
+    }
+
+    cout << "Listening for problems on " << socketPath << endl;
+
+    DomainWorkers workers;
+    unsigned long requestCount = 0;
+
+    while (true) {
+        const int clientFd = accept(listenFd, 0, 0);
+        if (clientFd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            cerr << "Could not accept connection: " << strerror(errno) << endl;
+            break;
+        }
+
+        // a client that stalls part-way through its request must not hold up those behind it
+        timeval timeout;
+        timeout.tv_sec = clientReadTimeout;
+        timeout.tv_usec = 0;
+        setsockopt(clientFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        PlanRequest request;
+        WorkerChannel client(clientFd);
+
+        if (client.read(request)) {
+            request.arguments.insert(request.arguments.begin(), defaultArguments.begin(), defaultArguments.end());
+
+            PlanResult failed;
+            failed.error = serveRequest(request, workers, listenFd, clientFd, ++requestCount);
+            if (!failed.error.empty()) {
+                client.writeFrame(WorkerChannel::E_RESULT_FRAME, failed);
+            }
+        }
+
+        close(clientFd);
+    }
+
+    while (!workers.empty()) {
+        finishDomainWorker(workers.begin()->second);
+        workers.erase(workers.begin());
+    }
+
+    close(listenFd);
+    unlink(socketPath.c_str());
+    return 1;
+}
+
+PlanResult solveOnServer(const string & socketPath, const PlanRequest & request, const PlanCallback & onImprovedPlan)
+{
+    PlanResult toReturn;
+
+    sockaddr_un address;
+    if (!makeSocketAddress(socketPath, address)) {
+        toReturn.error = "Socket path " + socketPath + " is too long";
+        return toReturn;
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        toReturn.error = string("Could not create socket: ") + strerror(errno);
+        return toReturn;
+    }
+
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        toReturn.error = "Could not connect to the planner at " + socketPath + ": " + strerror(errno);
+        close(fd);
+        return toReturn;
+    }
+
+    WorkerChannel server(fd);
+
+    if (!server.write(request) || !server.readResult(toReturn, onImprovedPlan)) {
+        toReturn = PlanResult();
+        toReturn.error = "The planner at " + socketPath + " did not return a result";
+    }
+
+    close(fd);
+    return toReturn;
+}
+
+};
@@ -0,0 +1,312 @@
+/************************************************************************
+ * This file is part of OPTIC.
+ *
+ * OPTIC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * OPTIC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OPTIC.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ************************************************************************/
+
+#ifndef OPTICWORKER_H
+#define OPTICWORKER_H
+
+/** @file opticWorker.h
+ *  @brief Internals shared by <code>PlannerContext</code> and the planner's server: not installed.
+ */
+
+#include "opticAPI.h"
+
+#include <cerrno>
+#include <string>
+
+#include <unistd.h>
+
+namespace Planner
+{
+
+/** @brief Binary encoding of requests and results, as exchanged between the planner and its workers or clients, over a pipe or socket. */
+class WorkerChannel
+{
+
+private:
+
+    int fd;
+
+    bool writeBytes(const void * const data, const size_t & length) {
+        const char * from = static_cast<const char*>(data);
+        size_t remaining = length;
+        while (remaining) {
+            const ssize_t written = ::write(fd, from, remaining);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            from += written;
+            remaining -= written;
+        }
+        return true;
+    }
+
+    bool readBytes(void * const data, const size_t & length) {
+        char * to = static_cast<char*>(data);
+        size_t remaining = length;
+        while (remaining) {
+            const ssize_t got = ::read(fd, to, remaining);
+            if (got < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (got == 0) {
+                return false;
+            }
+            to += got;
+            remaining -= got;
+        }
+        return true;
+    }
+
+    template<typename T>
+    bool writeValue(const T & v) {
+        return writeBytes(&v, sizeof(T));
+    }
+
+    template<typename T>
+    bool readValue(T & v) {
+        return readBytes(&v, sizeof(T));
+    }
+
+    bool writeString(const std::string & s) {
+        const unsigned int length = s.size();
+        return (writeValue(length) && writeBytes(s.data(), length));
+    }
+
+    bool readString(std::string & s) {
+        unsigned int length;
+        if (!readValue(length)) return false;
+        s.resize(length);
+        return (length == 0 || readBytes(&(s[0]), length));
+    }
+
+public:
+
+    WorkerChannel(const int & fdIn) : fd(fdIn) {
+    }
+
+    bool write(const PlanRequest & r) {
+        const unsigned int argCount = r.arguments.size();
+
+        if (!writeString(r.domain) || !writeString(r.problem) || !writeValue(r.timeLimit) || !writeValue(argCount)) {
+            return false;
+        }
+        for (unsigned int a = 0; a < argCount; ++a) {
+            if (!writeString(r.arguments[a])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool read(PlanRequest & r) {
+        unsigned int argCount;
+
+        if (!readString(r.domain) || !readString(r.problem) || !readValue(r.timeLimit) || !readValue(argCount)) {
+            return false;
+        }
+        r.arguments.resize(argCount);
+        for (unsigned int a = 0; a < argCount; ++a) {
+            if (!readString(r.arguments[a])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /** @brief The kinds of frame sent back from a worker: any number of improved plans, then the result. */
+    enum FrameType {
+        E_IMPROVED_PLAN_FRAME = 1,
+        E_RESULT_FRAME = 2
+    };
+
+    bool writeFrame(const unsigned char & type, const PlanResult & r) {
+        return (writeValue(type) && write(r));
+    }
+
+    bool readFrame(unsigned char & type, PlanResult & r) {
+        return (readValue(type) && read(r));
+    }
+
+    /** @brief Read frames until the result, passing each improved plan before it to <code>onImprovedPlan</code>, if set. */
+    bool readResult(PlanResult & r, const PlanCallback & onImprovedPlan) {
+        unsigned char type;
+        while (readFrame(type, r)) {
+            if (type == E_RESULT_FRAME) {
+                return true;
+            }
+            if (onImprovedPlan) {
+                onImprovedPlan(r);
+            }
+        }
+        return false;
+    }
+
+    bool write(const PlanResult & r) {
+        const unsigned char solved = (r.solved ? 1 : 0);
+        const unsigned int stepCount = r.steps.size();
+
+        if (!writeValue(solved) || !writeValue(r.quality) || !writeValue(r.statesEvaluated) || !writeString(r.error) || !writeValue(stepCount)) {
+            return false;
+        }
+        for (unsigned int s = 0; s < stepCount; ++s) {
+            const PlanStep & step = r.steps[s];
+            const unsigned int parameterCount = step.parameters.size();
+            if (!writeValue(step.time) || !writeString(step.action) || !writeValue(step.duration)
+                || !writeValue(step.actionID) || !writeString(step.operatorName) || !writeValue(parameterCount)) {
+                return false;
+            }
+            for (unsigned int p = 0; p < parameterCount; ++p) {
+                if (!writeString(step.parameters[p])) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool read(PlanResult & r) {
+        unsigned char solved;
+        unsigned int stepCount;
+
+        if (!readValue(solved) || !readValue(r.quality) || !readValue(r.statesEvaluated) || !readString(r.error) || !readValue(stepCount)) {
+            return false;
+        }
+        r.solved = solved;
+        r.steps.resize(stepCount);
+        for (unsigned int s = 0; s < stepCount; ++s) {
+            PlanStep & step = r.steps[s];
+            unsigned int parameterCount;
+            if (!readValue(step.time) || !readString(step.action) || !readValue(step.duration)
+                || !readValue(step.actionID) || !readString(step.operatorName) || !readValue(parameterCount)) {
+                return false;
+            }
+            step.parameters.resize(parameterCount);
+            for (unsigned int p = 0; p < parameterCount; ++p) {
+                if (!readString(step.parameters[p])) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool write(const DomainCheckResult & r) {
+        const unsigned char valid = (r.valid ? 1 : 0);
+        const unsigned int diagnosticCount = r.diagnostics.size();
+
+        if (!writeValue(valid) || !writeString(r.typeCheckLog) || !writeValue(diagnosticCount)) {
+            return false;
+        }
+        for (unsigned int d = 0; d < diagnosticCount; ++d) {
+            const unsigned char error = (r.diagnostics[d].error ? 1 : 0);
+            if (!writeValue(error) || !writeValue(r.diagnostics[d].line) || !writeString(r.diagnostics[d].description)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool read(DomainCheckResult & r) {
+        unsigned char valid;
+        unsigned int diagnosticCount;
+
+        if (!readValue(valid) || !readString(r.typeCheckLog) || !readValue(diagnosticCount)) {
+            return false;
+        }
+        r.valid = valid;
+        r.diagnostics.resize(diagnosticCount);
+        for (unsigned int d = 0; d < diagnosticCount; ++d) {
+            unsigned char error;
+            if (!readValue(error) || !readValue(r.diagnostics[d].line) || !readString(r.diagnostics[d].description)) {
+                return false;
+            }
+            r.diagnostics[d].error = error;
+        }
+        return true;
+    }
+};
+
+/** @brief Parse and type-check the domain ahead of any request, so processes forked afterwards start from the parsed domain.
+ *
+ *  Once this has been called, <code>solveInProcess()</code> only parses the problem, and rejects
+ *  requests for any other domain.
+ */
+void parseDomainInAdvance(const std::string & domain);
+
+/** @brief Stream each improved plan search finds to the given file descriptor, as an improved-plan frame. */
+void streamImprovedPlans(const int & fd);
+
+/** @brief The body of <code>optic_planner --worker &lt;requestFd&gt; &lt;resultFd&gt;</code>, as run by <code>PlannerContext</code>.
+ *
+ *  Reads one request, solves it with <code>solveInProcess()</code>, and writes any improved plans,
+ *  then the result, as frames.  SIGUSR1 cancels the search.
+ *
+ *  @return The exit status for the process.
+ */
+int runWorker(const int & requestFd, const int & resultFd);
+
+/** @brief The body of <code>optic_planner --check-worker &lt;requestFd&gt; &lt;resultFd&gt;</code>, as run by <code>checkDomain()</code>.
+ *
+ *  Reads a request, of which only the domain is used, and writes the result of <code>checkDomainInProcess()</code>.
+ *
+ *  @return The exit status for the process.
+ */
+int runDomainCheckWorker(const int & requestFd, const int & resultFd);
+
+/** @brief Solve a request in a process forked, but not exec'd, from this one, so it starts from this process's state.
+ *
+ *  This is how the server's domain workers start each solve from the domain they have already
+ *  parsed.  Only call this from a single-threaded process: a library caller should use
+ *  <code>solve()</code> or <code>PlannerContext</code> instead.
+ */
+PlanResult solveInForkedWorker(const PlanRequest & request, const PlanCallback & onImprovedPlan);
+
+struct Solution;
+
+/** @brief Fill in a result from a solution found by search. */
+void describeSolution(const Solution & solution, PlanResult & result);
+
+/** @brief If <code>-Q</code> was given, and search was not cancelled, reschedule the plan found to optimise the metric, updating its quality. */
+void scheduleSolutionToMetric(Solution & solution, const CommandLineOptions & options);
+
+/** @brief Write the plan found (or that none was) as requested by <code>-u</code> and <code>-J</code>.
+ *
+ *  For <code>-u</code>, a result frame follows any improved-plan frames already streamed; for
+ *  <code>-J</code>, the file holds the plan as written by <code>writePlanAsJSON()</code>.
+ */
+void writeStructuredPlan(const Solution & solution, const CommandLineOptions & options);
+void writeStructuredPlan(const PlanResult & result, const CommandLineOptions & options);
+
+/** @brief Search under each configuration of <code>options.portfolio</code> at once, sharing one preprocessing pass.
+ *
+ *  Each configuration searches in its own process, forked once the task has been ground and analysed,
+ *  so all of them share the preprocessed task.  If the plan quality is not being optimised, the first
+ *  plan found wins, and the other configurations are stopped; otherwise, all carry on until they
+ *  finish or the time limit passes, and the best plan found by any of them wins.
+ *
+ *  @param options         The options set by the command line: the search switches of each configuration are applied on top
+ *  @param result          Filled in with the winning plan, or why there is none
+ *  @param onImprovedPlan  If set, called with each plan that improves on the best found by any configuration
+ */
+void searchPortfolio(const CommandLineOptions & options, PlanResult & result, const PlanCallback & onImprovedPlan);
+
+};
+
+#endif
@@ -306,6 +306,7 @@ void POTHelper_updateForInstantaneousEffects(MinimalState & theState,
                     PropositionAnnotation & toUpdate = theState.retired.insert(*stateItr).first->second;
                     toUpdate.markAsDeleted(stepBA);
                     theState.first.erase(stateItr);
+                    theState.toggleFactInHash(litID);
 
                     if (applyDebug) {
                         cout << "\t" << *(*effItr) << " was true, but has now been deleted\n";
@@ -443,6 +444,7 @@ void POTHelper_updateForInstantaneousEffects(MinimalState & theState,
                     PropositionAnnotation & toUpdate = theState.first.insert(*stateItr).first->second;
                     toUpdate.markAsAdded(stepBA);
                     theState.retired.erase(stateItr);
+                    theState.toggleFactInHash(litID);
 
                     if (applyDebug) {
                         cout << ", and is now available from " << stepBA << "\n";
@@ -470,6 +472,7 @@ void POTHelper_updateForInstantaneousEffects(MinimalState & theState,
 
                 } else {
                     
+                    theState.toggleFactInHash(litID);
                     newlyAdded.insert(litID);
 //                     const map<int, list<int> > & factToPrefID = RPGBuilder::getLiteralsToGoalIndex();
 //                     const map<int, list<int> >::const_iterator gItr = factToPrefID.find(litID);
@@ -0,0 +1,150 @@
+/************************************************************************
+ * This file is part of OPTIC.
+ *
+ * OPTIC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * OPTIC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OPTIC.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ************************************************************************/
+
+#include "searchprofile.h"
+
+#include "RPGBuilder.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+using std::cerr;
+using std::endl;
+using std::ostream;
+using std::string;
+
+namespace Planner
+{
+
+/** @brief How often the profile is rewritten during search, so a run that is killed still leaves one behind. */
+static const std::chrono::seconds periodicWriteInterval(10);
+
+/** @brief The name of each phase in the JSON written, indexed by <code>SearchProfile::Phase</code>. */
+static const char * const phaseNames[SearchProfile::E_PHASE_COUNT] = {
+    "applyAction",
+    "temporalSoundness",
+    "lpScheduling",
+    "rpgExpansion",
+    "relaxedPlanExtraction",
+    "stateHashInsert",
+    "stateHashLookup",
+    "openListPush",
+    "openListPop"
+};
+
+bool SearchProfile::enabled = false;
+string SearchProfile::outputFile;
+
+SearchProfile::Timer * SearchProfile::innermost = 0;
+
+unsigned long SearchProfile::calls[SearchProfile::E_PHASE_COUNT];
+double SearchProfile::totalSeconds[SearchProfile::E_PHASE_COUNT];
+double SearchProfile::selfSeconds[SearchProfile::E_PHASE_COUNT];
+
+size_t SearchProfile::peakOpenListSize = 0;
+size_t SearchProfile::peakClosedListSize = 0;
+
+std::chrono::steady_clock::time_point SearchProfile::searchStartedAt;
+std::chrono::steady_clock::time_point SearchProfile::nextPeriodicWrite;
+
+SearchProfile::Timer::~Timer()
+{
+    if (!timing) return;
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    ++calls[phase];
+    totalSeconds[phase] += seconds;
+    selfSeconds[phase] += seconds - nestedSeconds;
+
+    if (outer) {
+        outer->nestedSeconds += seconds;
+    }
+    innermost = outer;
+}
+
+void SearchProfile::setOutputFile(const string & filename)
+{
+    outputFile = filename;
+    enabled = true;
+}
+
+void SearchProfile::suffixOutputFile(const string & suffix)
+{
+    if (enabled) {
+        outputFile += "." + suffix;
+    }
+}
+
+void SearchProfile::searchStarted()
+{
+    searchStartedAt = std::chrono::steady_clock::now();
+    nextPeriodicWrite = searchStartedAt + periodicWriteInterval;
+}
+
+void SearchProfile::searchFinished()
+{
+    if (enabled) {
+        writeOutputFile();
+    }
+}
+
+void SearchProfile::writeAsJSON(ostream & o)
+{
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - searchStartedAt).count();
+
+    o << "{\"searchSeconds\":" << elapsed;
+    o << ",\"statesEvaluated\":" << RPGHeuristic::statesEvaluated;
+    o << ",\"peakOpenListSize\":" << peakOpenListSize;
+    o << ",\"peakClosedListSize\":" << peakClosedListSize;
+    o << ",\"phases\":{";
+    for (int p = 0; p < E_PHASE_COUNT; ++p) {
+        if (p) o << ",";
+        o << "\"" << phaseNames[p] << "\":{\"calls\":" << calls[p]
+          << ",\"seconds\":" << totalSeconds[p]
+          << ",\"selfSeconds\":" << selfSeconds[p] << "}";
+    }
+    o << "}}\n";
+}
+
+void SearchProfile::writeOutputFile()
+{
+    nextPeriodicWrite = std::chrono::steady_clock::now() + periodicWriteInterval;
+
+    // write alongside, then rename over, so anyone reading the profile mid-search never sees half of it
+    const string partialFile = outputFile + "." + std::to_string(getpid()) + ".partial";
+
+    {
+        std::ofstream profileOut(partialFile.c_str());
+        if (!profileOut.is_open()) {
+            cerr << "Could not write the search profile to " << partialFile << endl;
+            return;
+        }
+        writeAsJSON(profileOut);
+    }
+
+    if (std::rename(partialFile.c_str(), outputFile.c_str()) != 0) {
+        cerr << "Could not write the search profile to " << outputFile << endl;
+    }
+}
+
+};
@@ -0,0 +1,159 @@
+/************************************************************************
+ * This file is part of OPTIC.
+ *
+ * OPTIC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * OPTIC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OPTIC.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ************************************************************************/
+
+#ifndef SEARCHPROFILE_H
+#define SEARCHPROFILE_H
+
+/** @file searchprofile.h
+ *  @brief Counts and times the phases of search, for <code>-P&lt;file&gt;</code>.
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+namespace Planner
+{
+
+/** @brief Where search spends its time: the calls made to each phase, and the time spent in them.
+ *
+ *  Profiling is off unless an output file is set, in which case each phase is timed with the steady clock.
+ *  Phases can nest: the relaxed plan, for instance, is extracted within <code>RPGHeuristic::getRelaxedPlan()</code>,
+ *  which is timed as RPG expansion.  So for each phase, both the total time spent in it and the time spent in it
+ *  but not in any phase nested within it are kept.
+ */
+class SearchProfile
+{
+
+public:
+
+    enum Phase {
+        E_APPLY_ACTION,
+        E_TEMPORAL_SOUNDNESS,
+        E_LP_SCHEDULING,
+        E_RPG_EXPANSION,
+        E_RELAXED_PLAN_EXTRACTION,
+        E_STATE_HASH_INSERT,
+        E_STATE_HASH_LOOKUP,
+        E_OPEN_LIST_PUSH,
+        E_OPEN_LIST_POP,
+        E_PHASE_COUNT
+    };
+
+    /** @brief Times one call to a phase, from construction to destruction, if profiling is enabled. */
+    class Timer
+    {
+
+    private:
+
+        const Phase phase;
+        const bool timing;
+        std::chrono::steady_clock::time_point started;
+
+        /** @brief Time spent in phases timed within this one, to discount from its own time. */
+        double nestedSeconds;
+
+        /** @brief The timer this one is nested within, if any. */
+        Timer * const outer;
+
+    public:
+
+        Timer(const Phase & p)
+            : phase(p), timing(enabled), nestedSeconds(0.0), outer(timing ? innermost : 0) {
+            if (timing) {
+                innermost = this;
+                started = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~Timer();
+    };
+
+    /** @brief Enable profiling, writing the profile to <code>filename</code> at the end of search, and every so often during it. */
+    static void setOutputFile(const std::string & filename);
+
+    /** @brief If profiling, write the profile to <code>&lt;file&gt;.&lt;suffix&gt;</code> instead, so processes forked to search
+     *  side by side do not overwrite each other's profiles.
+     */
+    static void suffixOutputFile(const std::string & suffix);
+
+    static bool isEnabled() {
+        return enabled;
+    }
+
+    /** @brief Spans a call to <code>FF::search()</code>: the profile is written however the search returns. */
+    class Session
+    {
+
+    public:
+
+        Session() {
+            searchStarted();
+        }
+
+        ~Session() {
+            searchFinished();
+        }
+    };
+
+    /** @brief Called once per state expanded: rewrite the profile if it has not been written recently. */
+    static void writeIfDue() {
+        if (enabled && std::chrono::steady_clock::now() >= nextPeriodicWrite) {
+            writeOutputFile();
+        }
+    }
+
+    static void noteOpenListSize(const size_t & size) {
+        if (size > peakOpenListSize) peakOpenListSize = size;
+    }
+
+    static void noteClosedListSize(const size_t & size) {
+        if (size > peakClosedListSize) peakClosedListSize = size;
+    }
+
+    /** @brief Write the profile to <code>o</code> as a single JSON object. */
+    static void writeAsJSON(std::ostream & o);
+
+private:
+
+    static bool enabled;
+    static std::string outputFile;
+
+    static Timer * innermost;
+
+    static unsigned long calls[E_PHASE_COUNT];
+    static double totalSeconds[E_PHASE_COUNT];
+    static double selfSeconds[E_PHASE_COUNT];
+
+    static size_t peakOpenListSize;
+    static size_t peakClosedListSize;
+
+    static std::chrono::steady_clock::time_point searchStartedAt;
+    static std::chrono::steady_clock::time_point nextPeriodicWrite;
+
+    static void searchStarted();
+    static void searchFinished();
+
+    /** @brief Write the profile to the output file, replacing it whole, and schedule the next periodic write. */
+    static void writeOutputFile();
+};
+
+};
+
+#endif
@@ -26,8 +26,11 @@
  ************************************************************************/
 
 #include "solver-clp.h"
+#include "globals.h"
 #include <coin/OsiClpSolverInterface.hpp>
 #include <coin/CglProbing.hpp>
+#include <coin/CbcEventHandler.hpp>
+#include <coin/ClpEventHandler.hpp>
 
 #include <iostream>
 using std::cout;
@@ -40,6 +43,49 @@ void readParams(char * argv[], const int & a)
 }
 #endif
 
+/** @brief Stops the simplex method if search has to stop. */
+class ClpStopWhenSearchMust : public ClpEventHandler
+{
+public:
+    ClpStopWhenSearchMust() {
+    }
+
+    ClpStopWhenSearchMust(const ClpStopWhenSearchMust & other)
+        : ClpEventHandler(other) {
+    }
+
+    virtual int event(Event whichEvent) {
+        if (whichEvent == endOfIteration && Planner::Globals::timeToStop()) {
+            return 0;
+        }
+        return -1;
+    }
+
+    virtual ClpEventHandler * clone() const {
+        return new ClpStopWhenSearchMust(*this);
+    }
+};
+
+/** @brief Stops branch-and-bound if search has to stop. */
+class CbcStopWhenSearchMust : public CbcEventHandler
+{
+public:
+    CbcStopWhenSearchMust() {
+    }
+
+    CbcStopWhenSearchMust(const CbcStopWhenSearchMust & other)
+        : CbcEventHandler(other) {
+    }
+
+    virtual CbcAction event(CbcEvent) {
+        return (Planner::Globals::timeToStop() ? stop : noAction);
+    }
+
+    virtual CbcEventHandler * clone() const {
+        return new CbcStopWhenSearchMust(*this);
+    }
+};
+
 double * MILPSolverCLP::scratchW = 0;
 int * MILPSolverCLP::scratchI = 0;
 int MILPSolverCLP::scratchSize = 0;
@@ -67,6 +113,8 @@ void MILPSolverCLP::transferToScratch(const vector<pair<int,double> > & entries)
 MILPSolverCLP::MILPSolverCLP()
 {
     lp = new OsiClpSolverInterface();
+    ClpStopWhenSearchMust stopLP;
+    lp->getModelPtr()->passInEventHandler(&stopLP);
     milp = 0;
     hasIntegerVariables = false;
     /*lp->setSpecialOptions();
@@ -81,6 +129,8 @@ MILPSolverCLP::MILPSolverCLP()
 MILPSolverCLP::MILPSolverCLP(const MILPSolverCLP & c)
 {
     lp = new OsiClpSolverInterface(*(c.lp));
+    ClpStopWhenSearchMust stopLP;
+    lp->getModelPtr()->passInEventHandler(&stopLP);
     hasIntegerVariables = c.hasIntegerVariables;
     milp = 0;
     solvectl = new ClpSolve();
@@ -332,6 +382,9 @@ bool MILPSolverCLP::solve(const bool & skipPresolve)
 
     milp->addCutGenerator(&pg,-1);
 
+    CbcStopWhenSearchMust stopMILP;
+    milp->passInEventHandler(&stopMILP);
+
     milp->setLogLevel(0);
     milp->branchAndBound();
 
@@ -2976,7 +2976,9 @@ void TemporalAnalysis::pullInAbstractTILs(MinimalState & theState, list<FFEvent>
         if (firstAdder->first >= 0.0) { // not an initial-state add
                 
             const PropositionAnnotation afterNow(theState.planLength);        
-            theState.first.insert(make_pair(tilItr->first, afterNow));
+            if (theState.first.insert(make_pair(tilItr->first, afterNow)).second) {
+                theState.toggleFactInHash(tilItr->first);
+            }
             
         } else {
             #ifndef NDEBUG
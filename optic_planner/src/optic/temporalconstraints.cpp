@@ -55,7 +55,7 @@ void INVARIANTERASE(map<int, int> & dest, const int & toErase, const int & bound
 #endif
 
 TemporalConstraints::TemporalConstraints()
-        : stepsComeBeforeThisOne(0), mostRecentStep(-1)
+        : stepCount(0), mostRecentStep(-1)
         #ifndef TOTALORDERSTATES
         ,lastStepToTouchPNE(RPGBuilder::getPNECount(), FluentInteraction())
         #endif
@@ -63,44 +63,55 @@ TemporalConstraints::TemporalConstraints()
 }
 
 TemporalConstraints::TemporalConstraints(const TemporalConstraints & other, const int extendBy)
-        : mostRecentStep(other.mostRecentStep)
+        : orderingChunks(other.orderingChunks), stepCount(other.stepCount), mostRecentStep(other.mostRecentStep)
         #ifndef TOTALORDERSTATES
         , lastStepToTouchPNE(other.lastStepToTouchPNE)
         #endif
 {
-    const int loopLim = other.stepsComeBeforeThisOne.size();
-    stepsComeBeforeThisOne = vector<map<int, bool>* >(loopLim + extendBy, (map<int, bool>*)0);
-    for (int i = 0; i < loopLim; ++i) {
-        const map<int, bool>* const toCopy = other.stepsComeBeforeThisOne[i];
-        if (toCopy) {
-            stepsComeBeforeThisOne[i] = new map<int, bool>(*toCopy);
-        }
+    if (extendBy) {
+        extend(extendBy);
     }
 }
 
 TemporalConstraints::~TemporalConstraints()
 {
-
-    const int loopLim = stepsComeBeforeThisOne.size();
-
-    for (int i = 0; i < loopLim; ++i) {
-        delete stepsComeBeforeThisOne[i];
-    }
 }
 
 
 void TemporalConstraints::addOrdering(const unsigned int & b, const unsigned int & a, const bool & ep)
 {
 
-    assert(a < stepsComeBeforeThisOne.size());
+    assert(a < stepCount);
     assert(a >= 0);
-    assert(b < stepsComeBeforeThisOne.size());
+    assert(b < stepCount);
     assert(b >= 0);
     assert(a != b);
-    map<int, bool> *& thingsBeforeA = stepsComeBeforeThisOne[a];
+
+    {
+        // if the ordering is already there, leave any chunk or map shared with other states as it is
+        const map<int, bool> * const existing = stepsBefore(a);
+        if (existing) {
+            const map<int, bool>::const_iterator exItr = existing->find(b);
+            if (exItr != existing->end() && (exItr->second || !ep)) {
+                return;
+            }
+        }
+    }
+
+    std::shared_ptr<OrderingChunk> & chunk = orderingChunks[a / orderingChunkSize];
+
+    if (!chunk) {
+        chunk = std::make_shared<OrderingChunk>();
+    } else if (chunk.use_count() > 1) {
+        chunk = std::make_shared<OrderingChunk>(*chunk);
+    }
+
+    std::shared_ptr<map<int, bool> > & thingsBeforeA = chunk->stepsComeBeforeThisOne[a % orderingChunkSize];
 
     if (!thingsBeforeA) {
-        thingsBeforeA = new map<int, bool>();
+        thingsBeforeA = std::make_shared<map<int, bool> >();
+    } else if (thingsBeforeA.use_count() > 1) {
+        thingsBeforeA = std::make_shared<map<int, bool> >(*thingsBeforeA);
     }
 
     const pair<map<int, bool>::iterator, bool> orderItr = thingsBeforeA->insert(make_pair(b, ep));
@@ -119,11 +130,9 @@ void TemporalConstraints::addOrdering(const unsigned int & b, const unsigned int
 
 void TemporalConstraints::extend(const int & extendBy)
 {
-    const int loopLim = stepsComeBeforeThisOne.size();
-    stepsComeBeforeThisOne.resize(loopLim + extendBy);
-    for (int i = 0; i < extendBy; ++i) {
-        stepsComeBeforeThisOne[i + loopLim] = (map<int, bool>*)0;
-    }
+    // entries past the old last step are never set, so the last chunk can simply be carried on into
+    stepCount += extendBy;
+    orderingChunks.resize((stepCount + orderingChunkSize - 1) / orderingChunkSize);
 }
 
 };
@@ -31,6 +31,7 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <memory>
 #include <cassert>
 
 using std::vector;
@@ -97,12 +98,31 @@ class TemporalConstraints
 {
 
 protected:
+
+    /** @brief How many steps' orderings are kept in each <code>OrderingChunk</code>. */
+    static const int orderingChunkSize = 32;
+
     /**
-     *  The vector of temporal constraints, for each step in the plan.  Each entry <code>i</code> in the vector
-     *  consists of a map, the keys of which denote the steps that must precede <code>i</code>, and
-     *  the corresponding keys, if <code>true</code> denote that separation of at least epsilon is needed.
+     *  The temporal constraints for a run of <code>orderingChunkSize</code> steps.  Each entry <code>i</code>
+     *  is a map, the keys of which denote the steps that must precede step <code>i</code> of the run, and
+     *  the corresponding values, if <code>true</code>, denote that separation of at least epsilon is needed.
+     *  A null entry means no steps must precede it.
      */
-    vector<map<int, bool> * > stepsComeBeforeThisOne;
+    struct OrderingChunk {
+        std::shared_ptr<map<int, bool> > stepsComeBeforeThisOne[orderingChunkSize];
+    };
+
+    /**
+     *  The temporal constraints for each step in the plan, in chunks, a null chunk meaning there are none.
+     *
+     *  The chunks, and the maps within them, are shared between copies of the constraints, and only copied
+     *  when an ordering is added to one that is shared.  Copying the constraints for a successor state, then
+     *  adding the orderings of the action applied, therefore copies only the chunks and maps that change.
+     */
+    vector<std::shared_ptr<OrderingChunk> > orderingChunks;
+
+    /** @brief The number of steps for which there are temporal constraints. */
+    unsigned int stepCount;
 
     /**
      *  The index of the step most recently added to the plan.  Used by TotalOrderTransformer
@@ -162,12 +182,13 @@ public:
      *             the corresponding keys, if <code>true</code>, denote that separation of at least epsilon is needed.
      */
     const map<int, bool> * stepsBefore(const int & i) const {
-        return stepsComeBeforeThisOne[i];
+        const OrderingChunk * const chunk = orderingChunks[i / orderingChunkSize].get();
+        return (chunk ? chunk->stepsComeBeforeThisOne[i % orderingChunkSize].get() : 0);
     }
 
     /**  Returns the current size of the vector of temporal constraints. */
     const unsigned int size() const {
-        return stepsComeBeforeThisOne.size();
+        return stepCount;
     }
 
     /**
@@ -77,6 +77,10 @@ public:
 	    filename= current_filename;
 	};
 
+    error_severity getSeverity() const { return severity; };
+    int getLine() const { return line; };
+    const string & getDescription() const { return description; };
+
     // describe error
     void report()
 	{
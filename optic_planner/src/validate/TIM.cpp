@@ -41,6 +41,7 @@ extern int yydebug;
 using std::ifstream;
 using std::ofstream;
 using std::ostream;
+using std::istream;
 using std::cerr;
 
 namespace VAL {
@@ -67,10 +68,14 @@ namespace TIM {
 
 TIMAnalyser * TA;
 
+/** The builder run over the domain's durative actions before it is type-checked, kept so it can be reversed once TIM has run. */
+static DurativeActionPredicateBuilder * domainActionBuilder = 0;
 
 
-void performTIMAnalysis(char * argv[])
+/** Set up the analysis that the domain and problem will be parsed into. */
+static void startTIMAnalysis()
 {
+    domainActionBuilder = 0;
     current_analysis = new analysis;
     IDopTabFactory * fac = new IDopTabFactory;
     current_analysis->setFactory(fac);
@@ -82,46 +87,59 @@ void performTIMAnalysis(char * argv[])
     unique_ptr<EPSBuilder> eps(new specEPSBuilder<TIMpredSymbol>());
     Associater::buildEPS = std::move(eps);
 
-    ifstream* current_in_stream;
     yydebug=0; // Set to 1 to output yacc trace
 
     yfl= new yyFlexLexer;
+}
 
-    // Loop over given args
+/** Parse a domain or problem from the given stream, attributing any parse errors to <code>name</code>. */
+static void parseTIMInput(istream * const in_stream, char * const name)
+{
+    current_filename = name;
+    line_no= 1;
 
-	for(int i = 0;i < 2;++i)
-	{
-		current_filename= argv[i];
-	//	cout << "File: " << current_filename << '\n';
-		current_in_stream = new ifstream(current_filename);
-		if (current_in_stream->bad())
-		{
-		    // Output a message now
-		    cerr << "Failed to open ";
-		    if (i) {
-			cerr << "problem";
-		    } else {
-			cerr << "domain";
-		    }
-		    cerr << " file " << current_filename << "\n";
-		    exit(0);
-		    // Log an error to be reported in summary later
-		    line_no= 0;
-		    log_error(E_FATAL,"Failed to open file");
-		}
-		else
-		{
-		    line_no= 1;
+    // Switch the tokeniser to the current input stream
+    yfl->switch_streams(in_stream,&cout);
+    yyparse();
 
-		    // Switch the tokeniser to the current input stream
-		    yfl->switch_streams(current_in_stream,&cout);
-		    yyparse();
+    // Output syntax tree
+    //if (top_thing) top_thing->display(0);
+}
 
-		    // Output syntax tree
-		    //if (top_thing) top_thing->display(0);
-		}
-		delete current_in_stream;
+/** Type-check the domain, exiting if it does not type-check. */
+static void typeCheckTIMDomain()
+{
+    domainActionBuilder = new DurativeActionPredicateBuilder;
+    current_analysis->the_domain->visit(domainActionBuilder);
+
+	theTC = new TypeChecker(current_analysis);
+
+    bool domainOkay = false;
+
+    try {
+        domainOkay = theTC->typecheckDomain();
     }
+    catch (std::exception e) {
+    }
+
+    if (!domainOkay) {
+		cerr << "Type Errors Encountered in Domain File\n";
+		cerr << "--------------------------------------\n\n";
+		cerr << "Due to type errors in the supplied domain file, the planner\n";
+		cerr << "has to terminate.  The log of type checking is as follows:\n\n";
+		Verbose = true;
+        try {
+            theTC->typecheckDomain();
+        }
+        catch (std::exception e) {
+        }
+		exit(1);
+	}
+}
+
+/** Having parsed the domain and problem, report errors, type-check, and run TIM. */
+static void completeTIMAnalysis()
+{
     // Output the errors from all input files
     if(current_analysis->error_list.errors) {
 	cerr << "Critical Errors Encountered in Domain/Problem File\n";
@@ -156,32 +174,11 @@ void performTIMAnalysis(char * argv[])
     #endif
 
 
-    DurativeActionPredicateBuilder dapb;
-    current_analysis->the_domain->visit(&dapb);
-
-	theTC = new TypeChecker(current_analysis);
-
-    bool domainOkay = false;
-
-    try {
-        domainOkay = theTC->typecheckDomain();
-    }
-    catch (std::exception e) {
+    if (!domainActionBuilder) {
+        typeCheckTIMDomain();
     }
 
-    if (!domainOkay) {
-		cerr << "Type Errors Encountered in Domain File\n";
-		cerr << "--------------------------------------\n\n";
-		cerr << "Due to type errors in the supplied domain file, the planner\n";
-		cerr << "has to terminate.  The log of type checking is as follows:\n\n";
-		Verbose = true;
-        try {
-            theTC->typecheckDomain();
-        }
-        catch (std::exception e) {
-        }
-		exit(1);
-	}
+    DurativeActionPredicateBuilder & dapb = *domainActionBuilder;
 
     bool problemOkay = false;
 
@@ -232,30 +229,18 @@ void performTIMAnalysis(char * argv[])
     };
 }
 
-void performModernTIMAnalysis(std::string domain_path, std::string problem_path)
+
+void performTIMAnalysis(char * argv[])
 {
-    current_analysis = new analysis;
-    IDopTabFactory * fac = new IDopTabFactory;
-    current_analysis->setFactory(fac);
-    current_analysis->pred_tab.replaceFactory<holding_pred_symbol>();
-    current_analysis->func_tab.replaceFactory<extended_func_symbol>();
-    current_analysis->const_tab.replaceFactory<TIMobjectSymbol>();
-    current_analysis->op_tab.replaceFactory<TIMactionSymbol>();
-    current_analysis->setFactory(new TIMfactory());
-    unique_ptr<EPSBuilder> eps(new specEPSBuilder<TIMpredSymbol>());
-    Associater::buildEPS = std::move(eps);
+    startTIMAnalysis();
 
     ifstream* current_in_stream;
-    yydebug=0; // Set to 1 to output yacc trace
-
-    yfl= new yyFlexLexer;
 
     // Loop over given args
-    std::vector<std::string> files = {domain_path, problem_path};
-    std::string current_filename;
+
 	for(int i = 0;i < 2;++i)
 	{
-		current_filename = files.at(i);
+		current_filename= argv[i];
 	//	cout << "File: " << current_filename << '\n';
 		current_in_stream = new ifstream(current_filename);
 		if (current_in_stream->bad())
@@ -275,125 +260,124 @@ void performModernTIMAnalysis(std::string domain_path, std::string problem_path)
 		}
 		else
 		{
-		    line_no= 1;
-
-		    // Switch the tokeniser to the current input stream
-		    yfl->switch_streams(current_in_stream,&cout);
-		    yyparse();
-
-		    // Output syntax tree
-		    //if (top_thing) top_thing->display(0);
+		    parseTIMInput(current_in_stream, argv[i]);
 		}
 		delete current_in_stream;
     }
-    // Output the errors from all input files
-    if(current_analysis->error_list.errors) {
-	cerr << "Critical Errors Encountered in Domain/Problem File\n";
-	cerr << "--------------------------------------------------\n\n";
-        cerr << "Due to critical errors in the supplied domain/problem file, the planner\n";
-	cerr << "has to terminate.  The errors encountered are as follows:\n";
-    	current_analysis->error_list.report();
-	exit(0);
-    } else if (current_analysis->error_list.warnings) {
-        cout << "Warnings encountered when parsing Domain/Problem File\n";
-	cerr << "-----------------------------------------------------\n\n";
-        cerr << "The supplied domain/problem file appear to violate part of the PDDL\n";
-        cerr << "language specification.  Specifically:\n";
-    	current_analysis->error_list.report();
-	cerr << "\nThe planner will continue, but you may wish to fix your files accordingly\n";
+
+    completeTIMAnalysis();
+}
+
+void performTIMAnalysis(istream & domain, istream & problem)
+{
+    static char domainName[] = "domain";
+    static char problemName[] = "problem";
+
+    startTIMAnalysis();
+    parseTIMInput(&domain, domainName);
+    parseTIMInput(&problem, problemName);
+    completeTIMAnalysis();
+}
+
+/** @brief A read-only stream buffer over a block of memory, so the lexer can read it without a copy being taken. */
+class MemoryBuffer : public std::streambuf
+{
+public:
+    MemoryBuffer(const char * const data, const size_t & length) {
+        char * const start = const_cast<char*>(data);
+        setg(start, start, start + length);
     }
+};
 
-    delete yfl;
+void performTIMAnalysis(const char * const domain, const size_t & domainLength,
+                        const char * const problem, const size_t & problemLength)
+{
+    parseTIMDomain(domain, domainLength);
+    performTIMAnalysisOfProblem(problem, problemLength);
+}
 
-    #ifdef STATICHACK
+void parseTIMDomain(const char * const domain, const size_t & domainLength)
+{
+    static char domainName[] = "domain";
 
-    cout << "Domain: '" << current_analysis->the_domain->name << "'\n";
-    if (current_analysis->the_domain->name.find("storage") == 0) {
-        cout << "HACK: Recognised the storage domain, overriding recognised static fact data\n";
-        overruleStaticInformation = true;
-        set<string> s;
-        s.insert("connected");
-        s.insert("compatible");
-        setStatics(s);
+    MemoryBuffer domainBuffer(domain, domainLength);
+    istream domainStream(&domainBuffer);
+
+    startTIMAnalysis();
+    parseTIMInput(&domainStream, domainName);
+}
+
+void parseAndTypeCheckTIMDomain(const char * const domain, const size_t & domainLength)
+{
+    parseTIMDomain(domain, domainLength);
+
+    // if the domain did not parse, leave the errors to be reported along with any in the problem
+    if (!current_analysis->error_list.errors && current_analysis->the_domain) {
+        typeCheckTIMDomain();
     }
+}
 
-    #endif
+void performTIMAnalysisOfProblem(const char * const problem, const size_t & problemLength)
+{
+    static char problemName[] = "problem";
 
+    MemoryBuffer problemBuffer(problem, problemLength);
+    istream problemStream(&problemBuffer);
 
-    DurativeActionPredicateBuilder dapb;
-    current_analysis->the_domain->visit(&dapb);
+    parseTIMInput(&problemStream, problemName);
+    completeTIMAnalysis();
+}
 
-	theTC = new TypeChecker(current_analysis);
+bool checkTIMDomain(const char * const domain, const size_t & domainLength, std::ostream & typeCheckLog)
+{
+    parseTIMDomain(domain, domainLength);
 
-    bool domainOkay = false;
+    delete yfl;
+    yfl = 0;
 
-    try {
-        domainOkay = theTC->typecheckDomain();
+    if (!current_analysis->the_domain) {
+        log_error(E_FATAL, "No domain definition found");
     }
-    catch (std::exception e) {
+
+    if (current_analysis->error_list.errors) {
+        return false;
     }
 
-    if (!domainOkay) {
-		cerr << "Type Errors Encountered in Domain File\n";
-		cerr << "--------------------------------------\n\n";
-		cerr << "Due to type errors in the supplied domain file, the planner\n";
-		cerr << "has to terminate.  The log of type checking is as follows:\n\n";
-		Verbose = true;
-        try {
-            theTC->typecheckDomain();
-        }
-        catch (std::exception e) {
-        }
-		exit(1);
-	}
+    DurativeActionPredicateBuilder dapb;
+    current_analysis->the_domain->visit(&dapb);
 
-    bool problemOkay = false;
+    TypeChecker tc(current_analysis);
+
+    bool domainOkay = false;
 
     try {
-        problemOkay = theTC->typecheckProblem();
+        domainOkay = tc.typecheckDomain();
     }
     catch (std::exception e) {
     }
 
-	if (!problemOkay) {
-		cerr << "Type Errors Encountered in Problem File\n";
-		cerr << "---------------------------------------\n\n";
-		cerr << "Due to type errors in the supplied problem file, the planner\n";
-		cerr << "has to terminate.  The log of type checking is as follows:\n\n";
-		Verbose = true;
+    if (!domainOkay) {
+        // type-check again, logging why it fails
+        ostream * const previousReport = report;
+        const bool previousVerbose = Verbose;
+        report = &typeCheckLog;
+        Verbose = true;
         try {
-            theTC->typecheckProblem();
+            tc.typecheckDomain();
         }
         catch (std::exception e) {
         }
+        report = previousReport;
+        Verbose = previousVerbose;
+    }
 
-		exit(1);
-	}
-    TypePredSubstituter a;
-    current_analysis->the_problem->visit(&a);
-   	current_analysis->the_domain->visit(&a);
-
-   	Analyser aa(dapb.getIgnores());
-   	current_analysis->the_problem->visit(&aa);
-   	current_analysis->the_domain->visit(&aa);
-
-//    current_analysis->the_domain->predicates->visit(&aa);
+    return domainOkay;
+}
 
-	if(FAverbose && current_analysis->the_domain->functions)
-		current_analysis->the_domain->functions->visit(&aa);
-    TA = new TIMAnalyser(*theTC,current_analysis);
-    current_analysis->the_domain->visit(TA);
-    current_analysis->the_problem->visit(TA);
-    for_each(current_analysis->the_domain->ops->begin(),
-    			current_analysis->the_domain->ops->end(),completeMutexes);
-	TA->checkSV();
-    dapb.reverse();
-    current_analysis->the_domain->visit(&dapb);
-    for(vector<durative_action*>::iterator i = aa.getFixedDAs().begin();
-    		i != aa.getFixedDAs().end();++i)
-    {
-    	(static_cast<TIMactionSymbol*>((*i)->name))->assertFixedDuration();
-    };
+void performModernTIMAnalysis(std::string domain_path, std::string problem_path)
+{
+    char * argv[2] = {&(domain_path[0]), &(problem_path[0])};
+    performTIMAnalysis(argv);
 }
 
 };
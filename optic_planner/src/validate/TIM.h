@@ -28,6 +28,10 @@
 #define __TIM
 
 #include "TimSupport.h"
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <string>
 
 
 namespace VAL {
@@ -39,6 +43,45 @@ extern TIMAnalyser * TA;
 
 void performTIMAnalysis(char * argv[]);
 
+/** @brief Parse the domain and problem from the given streams, rather than from files, then run TIM. */
+void performTIMAnalysis(std::istream & domain, std::istream & problem);
+
+/** @brief Parse the domain and problem from the given buffers, which need not be null-terminated, then run TIM.
+ *
+ *  The buffers are lexed in place, so must remain valid until this returns.
+ */
+void performTIMAnalysis(const char * const domain, const size_t & domainLength,
+                        const char * const problem, const size_t & problemLength);
+
+/** @brief Parse the domain from the given buffer, leaving the analysis ready for <code>performTIMAnalysisOfProblem()</code>.
+ *
+ *  A process that forks after this returns can then go on to plan for any number of problems
+ *  in the domain, without the domain being parsed again.
+ */
+void parseTIMDomain(const char * const domain, const size_t & domainLength);
+
+/** @brief As <code>parseTIMDomain()</code>, then type-check the domain, so a process that forks afterwards does not type-check it again for each problem.
+ *
+ *  TIM itself is left to <code>performTIMAnalysisOfProblem()</code>, as it analyses the problem's initial state along with the domain.
+ */
+void parseAndTypeCheckTIMDomain(const char * const domain, const size_t & domainLength);
+
+/** @brief Having called <code>parseTIMDomain()</code> or <code>parseAndTypeCheckTIMDomain()</code>, parse the problem from the given buffer, then run TIM. */
+void performTIMAnalysisOfProblem(const char * const problem, const size_t & problemLength);
+
+/** @brief Parse and type-check the domain in the given buffer, without going on to analyse it.
+ *
+ *  Unlike the other entry points, this does not exit on errors: the parser's errors and warnings
+ *  are left in <code>VAL::current_analysis->error_list</code>, and if the domain does not type-check,
+ *  the type checker's log is written to <code>typeCheckLog</code>.
+ *
+ *  @return <code>true</code> if the domain parsed without errors and type-checks.
+ */
+bool checkTIMDomain(const char * const domain, const size_t & domainLength, std::ostream & typeCheckLog);
+
+/** @brief As <code>performTIMAnalysis(char * argv[])</code>, given the paths to the domain and problem files. */
+void performModernTIMAnalysis(std::string domain_path, std::string problem_path);
+
 };
 
 #endif
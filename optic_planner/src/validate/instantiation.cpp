@@ -27,7 +27,14 @@
 #include <cstdio>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <assert.h>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <ptree.h>
 #include <FlexLexer.h>
 #include "TIM.h"
@@ -40,6 +47,7 @@
 
 
 using std::ifstream;
+using std::ofstream;
 using std::cerr;
 using std::endl;
 
@@ -1924,6 +1932,186 @@ void instantiatedOp::instantiate(const VAL::operator_ * op, const VAL::problem *
 };
 
 
+/** @brief  The start of a file written by <code>instantiatedOp::writeSnapshot()</code>.
+ *
+ *  This is followed by one record per ground operator: the index of its operator in the domain,
+ *  then the index of the object bound to each of its parameters, all as 32-bit integers.
+ */
+struct GroundingSnapshotHeader {
+    char magic[8];
+    uint64_t fingerprint;
+    uint32_t objectCount;
+    uint32_t operatorCount;
+    uint32_t groundOperatorCount;
+    uint32_t padding;
+};
+
+static const char groundingSnapshotMagic[8] = {'O', 'P', 'T', 'I', 'C', 'G', 'N', '1'};
+
+/** @brief  The objects that operator parameters can be bound to, in the order they are numbered in snapshots. */
+static void getSnapshotObjects(vector<VAL::const_symbol*> & objects)
+{
+    objects.reserve(current_analysis->const_tab.size());
+
+    const_symbol_table::const_iterator cItr = current_analysis->const_tab.begin();
+    const const_symbol_table::const_iterator cEnd = current_analysis->const_tab.end();
+
+    for (; cItr != cEnd; ++cItr) {
+        objects.push_back(cItr->second);
+    }
+}
+
+/** @brief  The operators in the domain, in the order they are numbered in snapshots. */
+static void getSnapshotOperators(vector<const VAL::operator_*> & operators)
+{
+    operators.insert(operators.end(), current_analysis->the_domain->ops->begin(), current_analysis->the_domain->ops->end());
+}
+
+bool instantiatedOp::writeSnapshot(const string & filename, const unsigned long long & fingerprint)
+{
+    vector<VAL::const_symbol*> objects;
+    getSnapshotObjects(objects);
+
+    vector<const VAL::operator_*> operators;
+    getSnapshotOperators(operators);
+
+    map<const VAL::const_symbol*, uint32_t> objectIndices;
+    for (uint32_t i = 0; i < objects.size(); ++i) {
+        objectIndices[objects[i]] = i;
+    }
+
+    map<const VAL::operator_*, uint32_t> operatorIndices;
+    for (uint32_t i = 0; i < operators.size(); ++i) {
+        operatorIndices[operators[i]] = i;
+    }
+
+    vector<uint32_t> records;
+
+    for (OpStore::iterator i = opsBegin(); i != opsEnd(); ++i) {
+        records.push_back(operatorIndices[(*i)->forOp()]);
+
+        const int arity = (*i)->arity();
+        for (int a = 0; a < arity; ++a) {
+            records.push_back(objectIndices[(*i)->getArg(a)]);
+        }
+    }
+
+    GroundingSnapshotHeader header;
+    memcpy(header.magic, groundingSnapshotMagic, sizeof(header.magic));
+    header.fingerprint = fingerprint;
+    header.objectCount = objects.size();
+    header.operatorCount = operators.size();
+    header.groundOperatorCount = howMany();
+    header.padding = 0;
+
+    // write alongside, then rename over: truncating the file in place would pull it from under any
+    // process that has it mapped, which would then fault on reading it
+    std::ostringstream partialFile;
+    partialFile << filename << "." << getpid() << ".tmp";
+
+    ofstream out(partialFile.str().c_str(), std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!records.empty()) {
+        out.write(reinterpret_cast<const char*>(&(records[0])), records.size() * sizeof(uint32_t));
+    }
+    out.close();
+
+    if (out.fail() || std::rename(partialFile.str().c_str(), filename.c_str()) != 0) {
+        std::remove(partialFile.str().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool instantiatedOp::instantiateFromSnapshot(const string & filename, const unsigned long long & fingerprint)
+{
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t) sizeof(GroundingSnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+
+    const size_t fileSize = fileStat.st_size;
+    void * const mapped = mmap(0, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+
+    const GroundingSnapshotHeader * const header = static_cast<const GroundingSnapshotHeader*>(mapped);
+    const uint32_t * const records = reinterpret_cast<const uint32_t*>(header + 1);
+    const size_t recordCount = (fileSize - sizeof(GroundingSnapshotHeader)) / sizeof(uint32_t);
+
+    vector<VAL::const_symbol*> objects;
+    getSnapshotObjects(objects);
+
+    vector<const VAL::operator_*> operators;
+    getSnapshotOperators(operators);
+
+    bool valid = (memcmp(header->magic, groundingSnapshotMagic, sizeof(header->magic)) == 0
+                  && header->fingerprint == fingerprint
+                  && header->objectCount == objects.size()
+                  && header->operatorCount == operators.size());
+
+    // check every record before creating any operators, so a bad file leaves nothing half-built
+
+    if (valid) {
+        size_t r = 0;
+        for (uint32_t g = 0; valid && g < header->groundOperatorCount; ++g) {
+            if (r >= recordCount || records[r] >= operators.size()) {
+                valid = false;
+                break;
+            }
+            const size_t arity = operators[records[r]]->parameters->size();
+            ++r;
+            if (r + arity > recordCount) {
+                valid = false;
+                break;
+            }
+            for (size_t a = 0; a < arity; ++a, ++r) {
+                if (records[r] >= objects.size()) {
+                    valid = false;
+                    break;
+                }
+            }
+        }
+        valid = (valid && r == recordCount);
+    }
+
+    if (valid) {
+        size_t r = 0;
+        for (uint32_t g = 0; g < header->groundOperatorCount; ++g) {
+            const VAL::operator_ * const op = operators[records[r++]];
+
+            FastEnvironment e(static_cast<const id_var_symbol_table*>(op->symtab)->numSyms());
+
+            var_symbol_list::const_iterator p = op->parameters->begin();
+            const var_symbol_list::const_iterator pEnd = op->parameters->end();
+
+            for (; p != pEnd; ++p) {
+                e[*p] = objects[records[r++]];
+            }
+
+            instantiatedOp * o = new instantiatedOp(op, e.copy());
+            if (instOps.insert(o)) {
+                delete o;
+            }
+        }
+    }
+
+    munmap(mapped, fileSize);
+
+    return valid;
+}
+
+
 void instantiatedDrv::instantiate(const VAL::derivation_rule * op, const VAL::problem * prb, VAL::TypeChecker & tc)
 {
     FastEnvironment e(static_cast<const id_var_symbol_table*>(op->get_vars())->numSyms());
@@ -622,6 +622,31 @@ public:
     /** @brief  Erase any ground operators whose preconditions are trivially unreachable. */
     static void filterOps(VAL::TypeChecker * const);
     
+    /** @brief  Save the ground operators to a binary snapshot, for <code>instantiateFromSnapshot()</code>.
+     *
+     *  This is intended to be called once filtering has reached a fix-point.  Each ground operator is
+     *  recorded as the index of its operator in the domain, and the indices of its parameters' objects.
+     *  The snapshot is written to a temporary file, then renamed over <code>filename</code>, so other
+     *  processes mapping the previous snapshot keep reading it intact.
+     *
+     *  @param filename     The file to write the snapshot to
+     *  @param fingerprint  Identifies the domain and problem the operators were ground for
+     *  @return <code>true</code> if the snapshot was written.
+     */
+    static bool writeSnapshot(const string & filename, const unsigned long long & fingerprint);
+
+    /** @brief  Recreate the ground operators from a binary snapshot, instead of calling <code>instantiate()</code>.
+     *
+     *  The file is memory-mapped, and only used if it was written for a task with the same fingerprint,
+     *  and the same numbers of operators and objects.  The operators are recreated in the order they
+     *  were saved, so they receive the same IDs as in the run that saved them.
+     *
+     *  @param filename     The snapshot file
+     *  @param fingerprint  Identifies the domain and problem being planned for
+     *  @return <code>true</code> if the ground operators were recreated; otherwise, none were created.
+     */
+    static bool instantiateFromSnapshot(const string & filename, const unsigned long long & fingerprint);
+
     /** @brief  Assign unique identifiers to non-static literals and PNEs.
      *
      * @see Literal::stateID , PNE::stateID
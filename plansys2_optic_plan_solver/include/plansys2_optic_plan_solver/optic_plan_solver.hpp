@@ -6,6 +6,7 @@
 #include <memory>
 #include <string>
 
+#include "optic_planner/opticAPI.h"
 #include "plansys2_core/PlanSolverBase.hpp"
 
 using std::chrono_literals::operator""s;
@@ -18,7 +19,9 @@ class OPTICPlanSolver : public PlanSolverBase
 private:
   std::string output_dir_parameter_name_;
   std::string parameter_name_;
+  std::string server_parameter_name_;
   rclcpp_lifecycle::LifecycleNode::SharedPtr lc_node_;
+  std::unique_ptr<Planner::PlannerContext> planner_;
 
 public:
   OPTICPlanSolver();
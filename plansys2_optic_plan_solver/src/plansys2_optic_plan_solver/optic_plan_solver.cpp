@@ -7,6 +7,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <fstream>
+#include <sstream>
 
 #include "plansys2_msgs/msg/plan_item.hpp"
 #include "plansys2_optic_plan_solver/optic_plan_solver.hpp"
@@ -61,6 +62,9 @@ void OPTICPlanSolver::configure(
   parameter_name_ = plugin_name + ".arguments";
   lc_node_ = lc_node;
   lc_node_->declare_parameter<std::string>(parameter_name_, "");
+  server_parameter_name_ = plugin_name + ".server_socket";
+  lc_node_->declare_parameter<std::string>(server_parameter_name_, "");
+  planner_ = std::make_unique<Planner::PlannerContext>();
   RCLCPP_INFO(lc_node_->get_logger(), "OPTICPlanSolver::configure");
 }
 
@@ -71,65 +75,40 @@ OPTICPlanSolver::getPlan(
   const rclcpp::Duration solver_timeout)
 {
   RCLCPP_INFO(lc_node_->get_logger(), "OPTICPlanSolver::getPlan");
-  if (node_namespace != "") {
-    std::filesystem::path tp = std::filesystem::temp_directory_path();
-    for (auto p : std::filesystem::path(node_namespace) ) {
-      if (p != std::filesystem::current_path().root_directory()) {
-        tp /= p;
-      }
-    }
-    std::filesystem::create_directories(tp);
+
+  Planner::PlanRequest request;
+  request.domain = domain;
+  request.problem = problem;
+  request.arguments = Planner::splitArguments(
+    lc_node_->get_parameter(parameter_name_).value_to_string());
+  request.timeLimit = solver_timeout.seconds();
+
+  const std::string server_socket =
+    lc_node_->get_parameter(server_parameter_name_).value_to_string();
+
+  const Planner::PlanCallback on_improved_plan =
+    [this](const Planner::PlanResult & improved) {
+      RCLCPP_INFO(
+        lc_node_->get_logger(), "Improved plan found: %zu steps, metric %f",
+        improved.steps.size(), improved.quality);
+    };
+
+  const Planner::PlanResult result = server_socket.empty() ?
+    planner_->solve(request, on_improved_plan) :
+    Planner::solveOnServer(server_socket, request, on_improved_plan);
+
+  if (!result.solved) {
+    RCLCPP_INFO(lc_node_->get_logger(), "No plan found: %s", result.error.c_str());
+    return {};
   }
 
   plansys2_msgs::msg::Plan ret;
-  std::ofstream domain_out("/tmp/" + node_namespace + "/domain.pddl");
-  domain_out << domain;
-  domain_out.close();
-
-  std::ofstream problem_out("/tmp/" + node_namespace + "/problem.pddl");
-  problem_out << problem;
-  problem_out.close();
-  std::stringstream timeout_s;
-  timeout_s << solver_timeout.seconds();
-  RCLCPP_INFO(lc_node_->get_logger(), "Sending system command");
-  system(
-    ("ros2 run optic_planner optic_planner " +
-    lc_node_->get_parameter(parameter_name_).value_to_string() +
-    " /tmp/" + node_namespace + "/domain.pddl /tmp/" + node_namespace + "/problem.pddl"
-    " -x" + timeout_s.str() +
-    " -y/tmp/" + node_namespace + "/plan").c_str());
-  RCLCPP_INFO(lc_node_->get_logger(), "Waiting for plan");
-  std::string line;
-  std::ifstream plan_file("/tmp/" + node_namespace + "/plan");
-  bool solution = false;
-
-  if (plan_file.is_open()) {
-    while (getline(plan_file, line)) {
-      if (!solution) {
-        if (line.find("Solution Found") != std::string::npos) {
-          solution = true;
-        }
-      } else if (line.front() != ';') {
-        plansys2_msgs::msg::PlanItem item;
-        size_t colon_pos = line.find(":");
-        size_t colon_par = line.find(")");
-        size_t colon_bra = line.find("[");
-
-        std::string time = line.substr(0, colon_pos);
-        std::string action = line.substr(colon_pos + 2, colon_par - colon_pos - 1);
-        std::string duration = line.substr(colon_bra + 1);
-        duration.pop_back();
-        std::cerr << "Time: " << time << " Action: " << action << " Duration: " << duration <<
-          std::endl;
-
-        item.time = std::stof(time);
-        item.action = action;
-        item.duration = std::stof(duration);
-
-        ret.items.push_back(item);
-      }
-    }
-    plan_file.close();
+  for (const auto & step : result.steps) {
+    plansys2_msgs::msg::PlanItem item;
+    item.time = step.time;
+    item.action = step.action;
+    item.duration = step.duration;
+    ret.items.push_back(item);
   }
 
   if (ret.items.empty()) {
@@ -144,28 +123,23 @@ OPTICPlanSolver::check_domain(
   const std::string & domain,
   const std::string & node_namespace)
 {
-  if (node_namespace != "") {
-    mkdir(("/tmp/" + node_namespace).c_str(), ACCESSPERMS);
-  }
-
-  std::ofstream domain_out("/tmp/" + node_namespace + "/check_domain.pddl");
-  domain_out << domain;
-  domain_out.close();
-
-  std::ofstream problem_out("/tmp/" + node_namespace + "/check_problem.pddl");
-  problem_out << "(define (problem void) (:domain plansys2))";
-  problem_out.close();
+  const Planner::DomainCheckResult result = Planner::checkDomain(domain);
 
-  system(
-    ("ros2 run optic_planner optic_planner /tmp/" + node_namespace + "/check_domain.pddl /tmp/" +
-    node_namespace + "/check_problem.pddl -x10 -y/tmp/" + node_namespace + "/check.out").c_str());
-
-  std::ifstream plan_file("/tmp/" + node_namespace + "/check.out");
+  if (result.valid) {
+    return "";
+  }
 
-  std::string result((std::istreambuf_iterator<char>(plan_file)),
-    std::istreambuf_iterator<char>());
+  std::ostringstream errors;
+  for (const auto & diagnostic : result.diagnostics) {
+    errors << "domain: line: " << diagnostic.line << ": " <<
+      (diagnostic.error ? "Error: " : "Warning: ") << diagnostic.description << "\n";
+  }
+  errors << result.typeCheckLog;
 
-  return result;
+  if (errors.str().empty()) {
+    return "The domain could not be checked";
+  }
+  return errors.str();
 }
 
 }  // namespace plansys2
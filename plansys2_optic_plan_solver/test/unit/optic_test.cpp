@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <string>
 #include <vector>
 #include <memory>
@@ -43,6 +44,69 @@ TEST(optic_plan_solver, generate_plan_good)
   test_plan_generation();
 }
 
+TEST(optic_plan_solver, generate_plan_repeatedly)
+{
+  std::string pkgpath = ament_index_cpp::get_package_share_directory("plansys2_optic_plan_solver");
+  std::ifstream domain_ifs(pkgpath + "/pddl/domain_simple.pddl");
+  std::string domain_str((
+      std::istreambuf_iterator<char>(domain_ifs)),
+    std::istreambuf_iterator<char>());
+
+  std::ifstream problem_ifs(pkgpath + "/pddl/problem_simple_1.pddl");
+  std::string problem_str((
+      std::istreambuf_iterator<char>(problem_ifs)),
+    std::istreambuf_iterator<char>());
+
+  auto node = rclcpp_lifecycle::LifecycleNode::make_shared("test_node");
+  auto planner = std::make_shared<plansys2::OPTICPlanSolver>();
+  planner->configure(node, "OPTIC");
+
+  // the second solve is handed to the worker the first left ready
+  for (int i = 0; i < 2; ++i) {
+    auto plan = planner->getPlan(domain_str, problem_str, "generate_plan_repeatedly");
+    ASSERT_TRUE(plan);
+    ASSERT_EQ(plan.value().items.size(), 3);
+    ASSERT_EQ(plan.value().items[0].action, "(move leia kitchen bedroom)");
+    ASSERT_EQ(plan.value().items[1].action, "(approach leia bedroom jack)");
+    ASSERT_EQ(plan.value().items[2].action, "(talk leia jack jack m1)");
+  }
+}
+
+TEST(optic_plan_solver, solve_through_api)
+{
+  std::string pkgpath = ament_index_cpp::get_package_share_directory("plansys2_optic_plan_solver");
+  std::ifstream domain_ifs(pkgpath + "/pddl/domain_simple.pddl");
+  std::string domain_str((
+      std::istreambuf_iterator<char>(domain_ifs)),
+    std::istreambuf_iterator<char>());
+
+  std::ifstream problem_ifs(pkgpath + "/pddl/problem_simple_1.pddl");
+  std::string problem_str((
+      std::istreambuf_iterator<char>(problem_ifs)),
+    std::istreambuf_iterator<char>());
+
+  // the worker executable has to be found through the ament index
+  unsetenv("OPTIC_PLANNER_EXECUTABLE");
+
+  Planner::PlanRequest request;
+  request.domain = domain_str;
+  request.problem = problem_str;
+  request.timeLimit = 15.0;
+
+  const Planner::PlanResult result = Planner::solve(request);
+  ASSERT_TRUE(result.solved) << result.error;
+  ASSERT_EQ(result.steps.size(), 3);
+  ASSERT_EQ(result.steps[0].action, "(move leia kitchen bedroom)");
+  ASSERT_EQ(result.steps[0].operatorName, "move");
+  ASSERT_EQ(
+    result.steps[0].parameters,
+    std::vector<std::string>({"leia", "kitchen", "bedroom"}));
+  ASSERT_EQ(result.steps[1].action, "(approach leia bedroom jack)");
+  ASSERT_EQ(result.steps[2].action, "(talk leia jack jack m1)");
+  ASSERT_GE(result.steps[1].time, result.steps[0].time);
+  ASSERT_GE(result.steps[2].time, result.steps[1].time);
+}
+
 TEST(optic_plan_solver, load_optic_plugin)
 {
   try {
@@ -57,44 +121,38 @@ TEST(optic_plan_solver, load_optic_plugin)
   }
 }
 
-// TEST(optic_plan_solver, check_1_ok_domain)
-// {
-//   std::cerr << "PRE TEST CHECK 1 OK DOMAIN" << std::endl;
-//   std::string pkgpath =
-// ament_index_cpp::get_package_share_directory("plansys2_optic_plan_solver");
-//   std::ifstream domain_ifs(pkgpath + "/pddl/domain_1_ok.pddl");
-//   std::string domain_str((
-//       std::istreambuf_iterator<char>(domain_ifs)),
-//     std::istreambuf_iterator<char>());
-
-//   auto node = rclcpp_lifecycle::LifecycleNode::make_shared("test_node");
-//   auto planner = std::make_shared<plansys2::OPTICPlanSolver>();
-//   std::cerr << "PRE CONFIGURE" << std::endl;
-//   planner->configure(node, "OPTIC");
-//   std::cerr << "PRE CHECK DOMAIN" << std::endl;
-
-//   auto result = planner->check_domain(domain_str, "check_1_ok_domain");
-//   std::cerr << "POST CHECK DOMAIN" << std::endl;
-//   ASSERT_TRUE(result.empty());
-// }
-
-// TEST(optic_plan_solver, check_2_error_domain)
-// {
-// std::string pkgpath =
-// ament_index_cpp::get_package_share_directory("plansys2_optic_plan_solver");
-//   std::ifstream domain_ifs(pkgpath + "/pddl/domain_2_error.pddl");
-//   std::string domain_str((
-//       std::istreambuf_iterator<char>(domain_ifs)),
-//     std::istreambuf_iterator<char>());
-
-//   auto node = rclcpp_lifecycle::LifecycleNode::make_shared("test_node");
-//   auto planner = std::make_shared<plansys2::OPTICPlanSolver>();
-//   planner->configure(node, "OPTIC");
-
-//   auto result = planner->check_domain(domain_str, "check_2_error_domain");
-
-//   ASSERT_FALSE(result.empty());
-// }
+TEST(optic_plan_solver, check_1_ok_domain)
+{
+  std::string pkgpath = ament_index_cpp::get_package_share_directory("plansys2_optic_plan_solver");
+  std::ifstream domain_ifs(pkgpath + "/pddl/domain_1_ok.pddl");
+  std::string domain_str((
+      std::istreambuf_iterator<char>(domain_ifs)),
+    std::istreambuf_iterator<char>());
+
+  auto node = rclcpp_lifecycle::LifecycleNode::make_shared("test_node");
+  auto planner = std::make_shared<plansys2::OPTICPlanSolver>();
+  planner->configure(node, "OPTIC");
+
+  auto result = planner->check_domain(domain_str, "check_1_ok_domain");
+  ASSERT_TRUE(result.empty());
+}
+
+TEST(optic_plan_solver, check_2_error_domain)
+{
+  std::string pkgpath = ament_index_cpp::get_package_share_directory("plansys2_optic_plan_solver");
+  std::ifstream domain_ifs(pkgpath + "/pddl/domain_2_error.pddl");
+  std::string domain_str((
+      std::istreambuf_iterator<char>(domain_ifs)),
+    std::istreambuf_iterator<char>());
+
+  auto node = rclcpp_lifecycle::LifecycleNode::make_shared("test_node");
+  auto planner = std::make_shared<plansys2::OPTICPlanSolver>();
+  planner->configure(node, "OPTIC");
+
+  auto result = planner->check_domain(domain_str, "check_2_error_domain");
+
+  ASSERT_FALSE(result.empty());
+}
 
 int main(int argc, char ** argv)
 {